@@ -2,6 +2,9 @@
 
 /* appearance */
 static const char font[]            = "-*-terminus-medium-r-*-*-16-*-*-*-*-*-*-*";
+#ifdef XFT
+static const char xftfont[]         = "monospace:size=11"; /* used instead of font */
+#endif
 
 static const char bordercolors[2][8] =
    /* focused    unfocused */
@@ -26,9 +29,21 @@ static const unsigned int borderpx  = 1;        /* border pixel of windows */
 static const unsigned int paddingpx = 10;       /* window padding in tilegap layout */
 static const unsigned int snap      = 10;       /* snap pixel */
 static const Bool overlap           = True;     /* False means no overlapping borders/padding */
+static const Bool outline           = False;    /* True means only an outline follows mouse moves/resizes */
+static const long focusdelay        = 0;        /* ms the pointer rests in a window before it gets focus */
+static const unsigned int barinterval = 33;     /* minimum ms between two paced bar redraws */
+static const int configrate         = 30;       /* configure requests answered per second and client, 0 for no limit */
+static const int configburst        = 10;       /* ... of which may come at once */
+static const long pinginterval      = 10000;    /* ms between pings to check clients respond, 0 to only ping on close */
+static const long pingtimeout       = 5000;     /* ms after which an unanswered client counts as hung */
+#ifdef XSYNC
+static const unsigned int synctimeout = 200;    /* ms to wait for a client to finish painting */
+#endif
 
 /* tagging */
 static const char *tags[] = { "1", "2", "3" };
+static const int maxworkspaces      = 1024;     /* further workspaces are numbered and made on demand */
+static const Bool hidevacant        = False;    /* True means vacant tags[] are left off the bar too */
 
 static const Rule rules[] = {
 	/* class      instance    title       tag (0 for current)  isfloating */
@@ -52,18 +67,30 @@ static const Layout layouts[] = {
 #define MODKEY Mod4Mask
 #define TAGKEYS(KEY,TAG) \
 	{ MODKEY,                       KEY,      view,           {.i = TAG} }, \
-	{ MODKEY|ShiftMask,             KEY,      tag,            {.i = TAG} }, 
+	{ MODKEY|ShiftMask,             KEY,      tag,            {.i = TAG} }, \
+	{ MODKEY|ControlMask,           KEY,      toggleview,     {.i = TAG} }, \
+	{ MODKEY|ControlMask|ShiftMask, KEY,      toggletag,      {.i = TAG} },
 
 /* commands */
 static const char *dmenucmd[] = { "dmenu_run", "-fn", font, "-nb", statuscolors[0][ColBG], "-nf", statuscolors[0][ColFG], "-sb", statuscolors[1][ColBG], "-sf", statuscolors[1][ColFG], NULL };
 static const char *termcmd[] = { "urxvt", NULL };
 
+/* warm pools: instances of cmd are started ahead of time and kept hidden, and
+ * spawn() with the same cmd array shows one of them on the current tag. Their
+ * windows are recognized by _NET_WM_PID, so cmd must not fork it off. */
+static const Pool pools[] = {
+	/* cmd        class       instances */
+	{ NULL,       "",         0 },    /* none, e.g.: */
+	/* { termcmd,    "URxvt",    1 }, */
+};
+
 static Key keys[] = {
 	/* modifier                     key        function        argument */
 	{ MODKEY,                       XK_r,      spawn,          {.v = dmenucmd } },
 	{ MODKEY,                       XK_Return, spawn,          {.v = termcmd } },
 	{ MODKEY,                       XK_j,      focusstack,     {.i = +1} },
 	{ MODKEY,                       XK_k,      focusstack,     {.i = -1} },
+	{ MODKEY,                       XK_slash,  switcher,       {0} },
 	{ MODKEY,                       XK_i,      incnmaster,     {.i = +1} },
 	{ MODKEY,                       XK_d,      incnmaster,     {.i = -1} },
 	{ MODKEY,                       XK_h,      setmfact,       {.f = -0.05} },
@@ -86,11 +113,33 @@ static Key keys[] = {
 	TAGKEYS(                        XK_7,                      6)
 	TAGKEYS(                        XK_8,                      7)
 	TAGKEYS(                        XK_9,                      8)
+	{ MODKEY|ShiftMask,             XK_s,      telemetry,      {.i = 10} },
 	{ MODKEY|ShiftMask,             XK_q,      quit,           {0} },
+	{ MODKEY|ControlMask|ShiftMask, XK_q,      restart,        {0} },
+};
+
+#ifdef IPC
+/* commands read from the IPC socket, one per line: <name> [argument] */
+static const Command commands[] = {
+	/* name             function        argument */
+	{ "view",           view,           CmdInt },
+	{ "toggleview",     toggleview,     CmdInt },
+	{ "tag",            tag,            CmdInt },
+	{ "toggletag",      toggletag,      CmdInt },
+	{ "setlayout",      setlayout,      CmdInt },
+	{ "setmfact",       setmfact,       CmdFloat },
+	{ "incnmaster",     incnmaster,     CmdInt },
+	{ "focusstack",     focusstack,     CmdInt },
+	{ "zoom",           zoom,           CmdNone },
+	{ "togglefloating", togglefloating, CmdNone },
+	{ "killclient",     killclient,     CmdNone },
+	{ "quit",           quit,           CmdNone },
 };
+#endif
 
 /* button definitions */
 /* click can be ClkLtSymbol, ClkStatusText, ClkWinTitle, ClkClientWin, or ClkRootWin */
+/* a {0} argument on ClkTagBar or ClkStatusText passes the clicked tag or status segment index */
 static Button buttons[] = {
 	/* click                event mask      button          function        argument */
 	{ ClkLtSymbol,          0,              Button1,        setlayout,      {.i = -1} },
@@ -100,5 +149,9 @@ static Button buttons[] = {
 	{ ClkClientWin,         MODKEY,         Button2,        togglefloating, {0} },
 	{ ClkClientWin,         MODKEY,         Button3,        resizemouse,    {0} },
 	{ ClkTagBar,            0,              Button1,        view,           {0} },
+	{ ClkTagBar,            0,              Button3,        toggleview,     {0} },
+	{ ClkTagBar,            MODKEY,         Button1,        tag,            {0} },
+	{ ClkTagBar,            MODKEY,         Button2,        addtag,         {0} },
+	{ ClkTagBar,            MODKEY,         Button3,        toggletag,      {0} },
 };
 
@@ -10,16 +10,46 @@ MANPREFIX = ${PREFIX}/share/man
 X11INC = /usr/X11R6/include
 X11LIB = /usr/X11R6/lib
 
+# Xft, uncomment to draw bar text through XRender with scalable fonts
+#XFTINC   = -I/usr/include/freetype2
+#XFTLIBS  = -lXft -lXrender -lfontconfig
+#XFTFLAGS = -DXFT
+
+# XSync, comment if you don't want _NET_WM_SYNC_REQUEST support
+XSYNCLIBS  = -lXext
+XSYNCFLAGS = -DXSYNC
+
+# MIT-SHM, uncomment to rasterize the bar client-side and upload it through
+# shared memory
+#SHMLIBS  = -lXext
+#SHMFLAGS = -DSHM
+
+# IPC, comment if you don't want the command socket
+IPCLIBS  = -lpthread
+IPCFLAGS = -DIPC
+
 # includes and libs
-INCS = -I${X11INC}
-LIBS = -L${X11LIB} -lX11
+INCS = -I${X11INC} ${XFTINC}
+LIBS = -L${X11LIB} -lX11 ${XFTLIBS} ${XSYNCLIBS} ${SHMLIBS} ${IPCLIBS}
 
 # flags
-CPPFLAGS = -D_BSD_SOURCE -D_POSIX_C_SOURCE=2 -DVERSION=\"${VERSION}\"
+CPPFLAGS = -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XFTFLAGS} ${XSYNCFLAGS} ${SHMFLAGS} ${IPCFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -std=c99 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = -s ${LIBS}
 
+# make pgo: optimization flags for the profile guided rebuild, and the X
+# server its workload runs on
+PGOFLAGS  = -O2 -flto
+PGOSERVER = Xvfb :97 -screen 0 1280x1024x24 -nolisten tcp
+PGOROUNDS = 50
+
+# make check: the soak's X server, which needs the X-Resource extension,
+# its rounds and the library it queries XRes with
+SOAKSERVER = Xvfb :98 -screen 0 1280x1024x24 -nolisten tcp
+SOAKROUNDS = 200
+SOAKLIBS   = -lXRes
+
 # Solaris
 #CFLAGS = -fast ${INCS} -DVERSION=\"${VERSION}\"
 #LDFLAGS = ${LIBS}
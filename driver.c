@@ -0,0 +1,131 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "driver.h"
+
+char *argv0;
+Display *dpy;
+Window root;
+int sock = -1;
+struct sockaddr_un addr = { .sun_family = AF_UNIX };
+static pid_t server = -1, wm = -1;
+
+/* Asks ldwm to quit, waits for it and takes the server down after it. */
+void
+cleanup(void) {
+	/* the reply may not make it out */
+	if(write(sock, "quit\n", 5) != 5)
+		die("%s: cannot write to ldwm: %s\n", argv0, strerror(errno));
+	waitpid(wm, NULL, 0);
+	wm = -1;
+	XCloseDisplay(dpy);
+	stop();
+}
+
+/* Sends line and waits for its reply, which also tells that ldwm has
+ * handled everything sent before. */
+void
+command(const char *line, char *reply, size_t size) {
+	char rest[4096], *buf;
+	ssize_t n;
+	size_t len = strlen(line), got = 0;
+
+	if(write(sock, line, len) != (ssize_t)len || write(sock, "\n", 1) != 1)
+		die("%s: cannot write to ldwm: %s\n", argv0, strerror(errno));
+	do { /* keep the head, drop the rest */
+		buf = got < size - 1 ? reply + got : rest;
+		if((n = read(sock, buf, buf == rest ? sizeof rest : size - 1 - got)) <= 0)
+			die("%s: ldwm went away\n", argv0);
+		if(buf != rest)
+			got += n;
+	} while(buf[n - 1] != '\n');
+	reply[got] = '\0';
+}
+
+void
+die(const char *errstr, ...) {
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	stop();
+	exit(EXIT_FAILURE);
+}
+
+long
+now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Starts the X server serverargv names, which must include its display,
+ * and ldwm on it, and connects to both. */
+void
+setup(char *ldwm, char **serverargv) {
+	char *wmargv[] = { ldwm, NULL };
+	char **a;
+	long t;
+
+	for(a = serverargv + 1; *a && (*a)[0] != ':'; a++);
+	if(!*a)
+		die("%s: no display among the server arguments\n", argv0);
+	setenv("DISPLAY", *a, 1);
+	snprintf(addr.sun_path, sizeof addr.sun_path, "/tmp/ldwm-driver-%d.sock", getpid());
+	setenv("LDWM_SOCKET", addr.sun_path, 1);
+
+	server = start(serverargv);
+	for(t = now(); !(dpy = XOpenDisplay(NULL)); usleep(10000))
+		if(now() - t > 5000)
+			die("%s: X server did not come up\n", argv0);
+	root = DefaultRootWindow(dpy);
+	wm = start(wmargv);
+	if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		die("%s: cannot create socket\n", argv0);
+	for(t = now(); connect(sock, (struct sockaddr *)&addr, sizeof addr) < 0; usleep(10000))
+		if(now() - t > 5000)
+			die("%s: ldwm did not open %s\n", argv0, addr.sun_path);
+}
+
+pid_t
+start(char **argv) {
+	pid_t pid;
+
+	if((pid = fork()) == 0) {
+		execvp(argv[0], argv);
+		fprintf(stderr, "%s: execvp %s", argv0, argv[0]);
+		perror(" failed");
+		_exit(EXIT_FAILURE);
+	}
+	if(pid < 0)
+		die("%s: cannot fork\n", argv0);
+	return pid;
+}
+
+/* Takes down what was started, so a failed run leaves no server behind. */
+void
+stop(void) {
+	if(wm > 0) {
+		kill(wm, SIGTERM);
+		waitpid(wm, NULL, 0);
+		wm = -1;
+	}
+	if(server > 0) {
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+		server = -1;
+	}
+	if(addr.sun_path[0])
+		unlink(addr.sun_path);
+}
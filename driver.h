@@ -0,0 +1,22 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * What workload and soak share: an X server and ldwm started as children,
+ * the connections to both and their teardown.
+ */
+#include <sys/types.h>
+#include <sys/un.h>
+#include <X11/Xlib.h>
+
+void cleanup(void);
+void command(const char *line, char *reply, size_t size);
+void die(const char *errstr, ...);
+long now(void);
+void setup(char *ldwm, char **serverargv);
+pid_t start(char **argv);
+void stop(void);
+
+extern char *argv0;
+extern Display *dpy;
+extern Window root;
+extern int sock;
+extern struct sockaddr_un addr;
@@ -19,14 +19,19 @@
  * To understand everything else, start reading main().
  */
 //#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <langinfo.h>
 #include <locale.h>
 #include <stdarg.h>
-//#include <signal.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 //#include <sys/types.h>
+#include <sys/select.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
@@ -34,30 +39,73 @@
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
+#ifdef XFT
+#include <X11/Xft/Xft.h>
+#endif /* XFT */
+#ifdef XSYNC
+#include <X11/extensions/sync.h>
+#endif /* XSYNC */
+#ifdef SHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif /* SHM */
+#ifdef IPC
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif /* IPC */
 
 /* macros */
 #define MAX(A, B)               ((A) > (B) ? (A) : (B))
 #define MIN(A, B)               ((A) < (B) ? (A) : (B))
 #define BUTTONMASK              (ButtonPressMask|ButtonReleaseMask)
 #define CLEANMASK(mask)         (mask & ~(numlockmask|LockMask) & (ShiftMask|ControlMask|Mod1Mask|Mod2Mask|Mod3Mask|Mod4Mask|Mod5Mask))
-#define curlayout               (layouts[mons->lt[mons->curtag]])
-#define ISVISIBLE(C)            ((C->tag == mons->curtag))
+#define curws                   (mons->ws[mons->curtag])
+#define curlayout               (layouts[curws->lt])
+#define ISVISIBLE(C)            (((C)->tags.w & mons->view.w) || intersects(&(C)->tags, &mons->view))
 #define LENGTH(X)               (sizeof X / sizeof X[0])
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define MAXCOLORS               12
+#define BLEND(B, F, A, S)       ((((((B) >> (S)) & 0xff) * (255 - (A)) + (((F) >> (S)) & 0xff) * (A)) / 255) << (S))
 #define TEXTW(X)                (textnw(X, strlen(X)) + dc.font.height)
+#define POOLCHUNK               64
+#define TAGBITS                 (sizeof(unsigned long) * 8)
+#define PROPSLOTS               8       /* properties counted apart per client */
+#define RATEHALFLIFE            1000    /* ms */
+#define IPCRING                 256     /* requests in flight, power of two */
+#define IPCCONNS                16
+#define IPCLINE                 512
+#define IPCQUEUE                64      /* events a subscriber may lag behind */
+#define GLYPHCACHE              512     /* power of two */
+#define SPANGAP                 16      /* clean columns merged into one upload */
+#define STATEVERSION            1       /* bump when a Saved* record changes */
+#define PLACESTEPS              64      /* spots place() tries per axis */
+#define LETTER(C)               (1ULL << (tolower((unsigned char)(C)) & 63))
+#define INFO(C)                 (&slabs[(C)->idx / POOLCHUNK]->cold[(C)->idx % POOLCHUNK])
 
 /* enums */
 enum { CurNormal, CurResize, CurMove, CurLast };        /* cursor */
 enum { ColFG, ColBG, ColLast };                         /* color */
 enum { NetSupported, NetWMName, NetWMState,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast };     /* EWMH atoms */
+       NetWMWindowTypeDialog, NetClientList, NetWMPing, NetWMPid,
+#ifdef XSYNC
+       NetWMSyncRequest, NetWMSyncRequestCounter,
+#endif /* XSYNC */
+       NetLast };                                           /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
+enum { Utf8String, XLast };                             /* other atoms */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast };             /* clicks */
+enum { CmdNone, CmdInt, CmdFloat };                     /* IPC arguments */
 
 typedef union {
 	int i;
@@ -74,36 +122,191 @@ typedef struct {
 	const Arg arg;
 } Button;
 
+typedef struct {
+	const char *name;
+	void (*func)(const Arg *arg);
+	int argtype;
+} Command;
+
+typedef struct { /* tags 0 .. TAGBITS-1 inline, any further ones in more */
+	unsigned long w;
+	unsigned long *more;
+	unsigned int nmore;
+} TagSet;
+
+typedef struct {
+	unsigned long total;
+	unsigned long rate;   /* recent hits << 8, halved every RATEHALFLIFE */
+	long last;            /* time of the last hit */
+} Counter;
+
+typedef struct {
+	Counter configs, props, steals, arranges, redraws, throttles;
+	struct {
+		Atom atom;
+		Counter k;
+	} prop[PROPSLOTS];    /* the busiest properties */
+} Telemetry;
+
+#ifdef IPC
+typedef struct { /* single producer, single consumer */
+	void *slot[IPCRING];
+	unsigned int head;    /* advanced by the consumer */
+	unsigned int tail;    /* advanced by the producer */
+} Ring;
+
+typedef struct {
+	unsigned int conn, gen;                 /* where the reply goes */
+	const Command *cmd;
+	void (*query)(FILE *f, const Arg *arg);
+	const char *error;                      /* set if the line did not parse */
+	Arg arg;
+} IpcRequest;
+
+typedef struct {
+	unsigned int conn, gen;
+	char *text;
+	size_t len;
+} IpcReply;
+
+typedef struct { /* one line for all subscribers, owned by the I/O thread */
+	unsigned int refs;    /* subscriber queues holding it */
+	unsigned long lost;   /* events dropped right before this one */
+	char *text;
+	size_t len;
+} IpcEvent;
+
+typedef struct { /* owned by the I/O thread */
+	int fd;               /* -1 if the slot is free */
+	unsigned int gen;     /* tells replies to an earlier connection apart */
+	char in[IPCLINE];
+	size_t inlen;
+	char *out;
+	size_t outlen, outoff;
+	unsigned int pending; /* requests awaiting their reply */
+	Bool eof;             /* the peer is done sending */
+	Bool hup;             /* the peer is gone; its input is still carried out */
+	Bool discard;         /* dropping the rest of a line too long */
+	Bool subscribed;      /* gets events */
+	IpcEvent *evq[IPCQUEUE]; /* events not yet copied to out */
+	unsigned int evhead, evlen;
+	unsigned long drops;  /* events it missed since the last note */
+} IpcConn;
+
+typedef struct {
+	const char *name;
+	void (*query)(FILE *f, const Arg *arg);
+} Query;
+#endif /* IPC */
+
 typedef struct Monitor Monitor;
 typedef struct Client Client;
-struct Client {
-	char name[256];
-	float mina, maxa;
-	int x, y, w, h;
-	int oldx, oldy, oldw, oldh;
-	int basew, baseh, incw, inch, maxw, maxh, minw, minh;
-	int bw, oldbw;
-    unsigned int tag;
-	Bool isfixed, isfloating, neverfocus, oldstate, isfullscreen;
+struct Client { /* hot: everything list walks, layouts and focus touch */
 	Client *next;
 	Client *snext;
 	Window win;
+	TagSet tags;
+	unsigned int idx;     /* stable slot in the client pool */
+	unsigned int isfixed : 1, isfloating : 1, neverfocus : 1, oldstate : 1, isfullscreen : 1;
+	unsigned int titlestale : 1; /* name changed since it was last read */
+	unsigned int ispooled : 1;   /* hidden and waiting in pools[INFO(c)->pool] */
+	unsigned int configwait : 1; /* a configure request is held back, see admitconfig() */
+	unsigned int canping : 1;    /* speaks _NET_WM_PING */
+	unsigned int pingwait : 1;   /* has not answered the last ping yet */
+	unsigned int ishung : 1;     /* ... within pingtimeout */
+	unsigned int isindexed : 1;  /* filed in the edge index of its workspaces */
+#ifdef XSYNC
+	unsigned int syncable : 1;   /* speaks _NET_WM_SYNC_REQUEST */
+	unsigned int syncwait : 1;   /* has not painted the last configure yet */
+	unsigned int syncdirty : 1;  /* geometry changed while waiting */
+#endif /* XSYNC */
+	int bw, oldbw;
+	int x, y, w, h;
+	int oldx, oldy, oldw, oldh;
 };
 
+typedef struct { /* cold: only read when drawing, matching rules or applying hints */
+	char name[256];
+	char class[64];
+	char instance[64];
+	float mina, maxa;
+	int basew, baseh, incw, inch, maxw, maxh, minw, minh;
+	unsigned int pool;
+	XConfigureRequestEvent lastreq;
+	int sentx, senty, sentw, senth, sentbw; /* last synthetic ConfigureNotify */
+	long configtat;       /* when the configure token bucket is full again */
+	long pingsent;        /* time of the last ping, in ms */
+	long hints;           /* XSizeHints flags */
+	int ix, iy, iw, ih;   /* outer geometry as filed in the edge index */
+	unsigned long long letters; /* a LETTER() per byte of name, class and instance */
+	Telemetry tm;
+#ifdef XSYNC
+	XSyncCounter counter;
+	XSyncAlarm alarm;
+	XSyncValue value;     /* last requested counter value */
+	long syncsent;        /* time of the last sync request, in ms */
+#endif /* XSYNC */
+} ClientInfo;
+
+typedef struct {
+	Client hot[POOLCHUNK];
+	ClientInfo cold[POOLCHUNK];
+} ClientSlab;
+
+typedef struct {
+	int x;                /* right edge (exclusive) of the region */
+	unsigned int click;
+	unsigned int arg;     /* tag index or status segment index */
+} BarRegion;
+
+typedef struct {
+	Client *c;
+	int score;            /* lower is better, see fuzzy() */
+	unsigned int order;   /* place in the focus stack, breaks ties */
+} Hit;
+
 typedef struct {
 	int x, y, w, h;
 	unsigned long colors[MAXCOLORS][2];
  	Drawable drawable;
 	GC gc;
+#ifdef XFT
+	XftDraw *xftdraw;
+#endif /* XFT */
 	struct {
 		int ascent;
 		int descent;
 		int height;
 		XFontSet set;
 		XFontStruct *xfont;
+		Font fid;       /* opened but not queried yet */
+#ifdef XFT
+		XftFont *xft;   /* glyphs are uploaded once into a server-side GlyphSet */
+#endif /* XFT */
 	} font;
 } DC; /* draw context */
 
+#ifdef SHM
+typedef struct {
+	unsigned int key;     /* bytes of the character, 0 marks a free slot */
+	int w;                /* advance in pixels */
+	unsigned char *alpha; /* w x bh coverage */
+} RasterGlyph;
+
+typedef struct {
+	Bool on;              /* the bar is rasterized client-side */
+	Bool shm, busy, full; /* MIT-SHM in use, upload pending, redraw everything */
+	int event;            /* ShmCompletion event type */
+	int rshift, gshift, bshift;
+	XImage *img;
+	XShmSegmentInfo info;
+	unsigned int *prev;   /* last uploaded frame */
+	unsigned char *cols;  /* dirty columns of the current frame */
+	RasterGlyph glyphs[GLYPHCACHE];
+	unsigned int nglyphs;
+} Raster; /* client-side bar raster */
+#endif /* SHM */
+
 typedef struct {
 	unsigned int mod;
 	KeySym keysym;
@@ -124,57 +327,207 @@ typedef struct {
 	Bool isfloating;
 } Rule;
 
+typedef struct {
+	const char **cmd;     /* spawn() with this very array takes a pooled window */
+	const char *class;
+	unsigned int n;       /* instances kept ready */
+} Pool;
+
+typedef struct {
+	int pos;
+	Client *c;
+} Edge;
+
+typedef struct {
+	unsigned int lt;
+	float mfact;
+	int nmaster;
+	unsigned int nclients; /* attached clients on this workspace */
+	Edge *xedges, *yedges; /* their sides, sorted by position, see fileedges() */
+	unsigned int nedges, edgesz;
+} Workspace;
+
+typedef struct { /* state handed from one instance to the next on restart */
+	char magic[4];
+	unsigned int version; /* STATEVERSION of the writer */
+	unsigned int statesz, wssz, clientsz; /* record sizes of the writer */
+	unsigned int nws, nclients, nview, curtag, prevtag;
+	Window sel;
+} SavedState;
+
+typedef struct {
+	unsigned int tag, lt;
+	float mfact;
+	int nmaster;
+} SavedWorkspace;
+
+typedef struct {
+	Window win;
+	unsigned int ntags;   /* followed by as many tag indices */
+	unsigned char isfloating, isfullscreen, oldstate, neverfocus;
+	unsigned char pool;   /* 1 + pool index of a pooled client, else 0 */
+	int x, y, w, h, oldx, oldy, oldw, oldh, bw, oldbw;
+	char class[64], instance[64];
+} SavedClient;
+
 /* function declarations */
+static void addregion(int x, unsigned int click, unsigned int arg);
+static void addtag(const Arg *arg);
+static Bool admitconfig(Client *c);
+static Client *allocclient(void);
 static void applyrules(Client *c);
 static Bool applysizehints(Client *c, int *x, int *y, int *w, int *h, Bool interact);
 static void arrange(void);
 static void attach(Client *c);
 static void attachstack(Client *c);
+static const BarRegion *barregion(int x);
 static void buttonpress(XEvent *e);
+#ifdef SHM
+static int charlen(const char *s, int len);
+#endif /* SHM */
 static void checkotherwm(void);
 static void cleanup(void);
 static void clientmessage(XEvent *e);
 static void configure(Client *c);
+static void configureclient(Client *c);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
+static void count(Counter *k);
+static void countprop(Client *c, Atom atom);
 static Monitor *createmon(void);
+static unsigned long decayed(const Counter *k, long t);
 static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static void die(const char *errstr, ...);
 static void drawbar(void);
 static void drawcoloredtext(char *text);
+static void drawoutline(Client *c, int x, int y, int w, int h);
+static void drawrect(int x, int y, int w, int h, Bool filled, unsigned long pixel);
 static void drawsquare(Bool filled, Bool empty, unsigned long col[ColLast]);
+static void drawstring(int x, int y, const char *text, int len, unsigned long pixel);
+static void drawswitcher(void);
 static void drawtext(const char *text, unsigned long col[ColLast], Bool pad);
+static unsigned int edgesearch(const Edge *e, unsigned int n, int pos);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
 static void floating(void);
+static void fileclient(Client *c);
+static void fileedges(Workspace *ws, Client *c, Bool on);
+static void fillpool(unsigned int i);
+static void finishfont(const char *fontstr);
 static void focus(Client *c);
 static void focusin(XEvent *e);
+static long flushbar(void);
+static long flushconfigs(void);
+static long flushfocus(void);
+#ifdef SHM
+static void flushglyphs(void);
+static void flushraster(void);
+#endif /* SHM */
+#ifdef IPC
+static void flushevents(void);
+#endif /* IPC */
 static void focusstack(const Arg *arg);
+static void freeclient(Client *c);
+static void freews(Workspace *ws);
+#ifdef IPC
+static void freeipc(void);
+#endif /* IPC */
+#ifdef SHM
+static void freeraster(void);
+#endif /* SHM */
+static int fuzzy(const char *s, const char *q, unsigned int len);
 static unsigned long getcolor(const char *colstr);
 static long getstate(Window w);
 static Bool gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static Workspace *getws(unsigned int t);
 static void grabbuttons(Client *c, Bool focused);
+#ifdef SHM
+static RasterGlyph *getglyph(const char *s, int len);
+#endif /* SHM */
 static void grabkeys(void);
+static Bool hastag(const TagSet *s, unsigned int t);
+static int hitcmp(const void *a, const void *b);
 static void incnmaster(const Arg *arg);
+static void indexclient(Client *c);
 static void initfont(const char *fontstr);
+#ifdef IPC
+static void initipc(void);
+#endif /* IPC */
+#ifdef SHM
+static void initraster(void);
+#endif /* SHM */
+static Bool intersects(const TagSet *a, const TagSet *b);
+#ifdef IPC
+static void ipcclose(IpcConn *c);
+static void ipcdeliver(IpcConn *c);
+static void ipcdispatch(void);
+static void ipcfanout(IpcConn *conns);
+static void ipclines(IpcConn *c, unsigned int i, unsigned int *inflight);
+static void ipcrelease(IpcEvent *ev);
+static void *ipcthread(void *unused);
+#endif /* IPC */
+static Bool isstacked(Client *c);
+#ifdef IPC
+static void jsonclient(FILE *f, Client *c);
+static void jsonstr(FILE *f, const char *s);
+static void jsonview(FILE *f);
+#endif /* IPC */
 static void keypress(XEvent *e);
 static void killclient(const Arg *arg);
+static Bool killhung(Client *c);
+static pid_t launch(const char **cmd);
 static void manage(Window w, XWindowAttributes *wa);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
+#ifdef XFT
+static unsigned short maskcomp(unsigned long pixel, unsigned long mask);
+#endif /* XFT */
+#ifdef SHM
+static int maskshift(unsigned long mask);
+#endif /* SHM */
 static void monocle(void);
 static void movemouse(const Arg *arg);
 static Client *nexttiled(Client *c);
+static int nexttag(const TagSet *s, unsigned int t);
+static void notify(const char *event, Client *c);
+static long now(void);
+static Bool occupied(unsigned int t);
+static Bool onlytag(const TagSet *s, unsigned int t);
+static long overlaparea(Workspace *ws, Client *c, int x, int y, int w, int h);
+static void ping(Client *c);
+static long pingclients(void);
+static void place(Client *c);
+static Bool poolclient(Client *c);
 static void pop(Client *);
 static void propertynotify(XEvent *e);
+static void prunepools(void);
+#ifdef IPC
+static void queryresources(FILE *f, const Arg *arg);
+static void querystate(FILE *f, const Arg *arg);
+static void querysubscribe(FILE *f, const Arg *arg);
+static void querytelemetry(FILE *f, const Arg *arg);
+#endif /* IPC */
 static void quit(const Arg *arg);
+static Client **rankclients(unsigned int *n);
+static void refreshtitle(Client *c);
+static void reindex(Client *c);
+static void releasews(unsigned int t);
+static void requestbar(void);
 static void resize(Client *c, int x, int y, int w, int h, Bool interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Arg *arg);
 static void restack(void);
+static void restart(const Arg *arg);
+static Bool restorestate(int fd);
+static void retag(Client *c, unsigned int t, Bool on);
+#ifdef IPC
+static void *ringget(Ring *r);
+static Bool ringput(Ring *r, void *p);
+#endif /* IPC */
 static void run(void);
+static int savestate(void);
 static void scan(void);
 static Bool sendevent(Client *c, Atom proto);
 static void setclientstate(Client *c, long state);
@@ -182,40 +535,71 @@ static void setfocus(Client *c);
 static void setfullscreen(Client *c, Bool fullscreen);
 static void setlayout(const Arg *arg);
 static void setmfact(const Arg *arg);
+static void setsent(Client *c);
+static void settag(TagSet *s, unsigned int t, Bool on);
 static void setup(void);
 static void showhide(Client *c);
 static void sigchld(int unused);
+static int snapedge(Client *c, int x, int y, Bool vertical);
 static void spawn(const Arg *arg);
+static Bool suspended(void);
+static void switcher(const Arg *arg);
+static void switcherdrop(Client *c);
+static void switcherkey(XKeyEvent *ev);
+static void switcherscan(Bool narrow);
+#ifdef XSYNC
+static void syncalarm(XEvent *e);
+static void syncrequest(Client *c);
+static long synctimeouts(void);
+#endif /* XSYNC */
 static void tag(const Arg *arg);
+static const char *tagname(unsigned int t);
+static void telemetry(const Arg *arg);
+static void throttled(Client *c);
 static int textnw(const char *text, unsigned int len);
 static void tile(void);
 static void tilegap(void);
 static void togglefloating(const Arg *arg);
+static void toggletag(const Arg *arg);
+static void toggleview(const Arg *arg);
 static void unfocus(Client *c, Bool setfocus);
 static void unmanage(Client *c, Bool destroyed);
 static void unmapnotify(XEvent *e);
+static void unpool(Client *c);
 static Bool updategeom(void);
 static void updatebars(void);
 static void updateclientlist(void);
 static void updatenumlockmask(void);
+static void updateprotocols(Client *c);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
+#ifdef XSYNC
+static void updatesync(Client *c);
+#endif /* XSYNC */
 static void updatetitle(Client *c);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
 static void view(const Arg *arg);
+static long winpid(Window w);
 static Client *wintoclient(Window w);
 static int xerror(Display *dpy, XErrorEvent *ee);
 static int xerrordummy(Display *dpy, XErrorEvent *ee);
+#ifdef SHM
+static int xerrorshm(Display *dpy, XErrorEvent *ee);
+#endif /* SHM */
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
+#ifdef XFT
+static void xftcolor(unsigned long pixel, XftColor *c);
+#endif /* XFT */
 static void zoom(const Arg *arg);
 
 /* variables */
 static const char broken[] = "broken";
+static const char hung[] = " (not responding)";
 static char stext[256];
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height */
-static int bh, blw = 0;      /* bar geometry */
+static int bh;               /* bar geometry */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
 static void (*handler[LASTEvent]) (XEvent *) = {
@@ -233,12 +617,83 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[PropertyNotify] = propertynotify,
 	[UnmapNotify] = unmapnotify
 };
-static Atom wmatom[WMLast], netatom[NetLast];
+static Atom wmatom[WMLast], netatom[NetLast], xatom[XLast];
+static const char *wmnames[WMLast] = {
+	[WMProtocols] = "WM_PROTOCOLS",
+	[WMDelete] = "WM_DELETE_WINDOW",
+	[WMState] = "WM_STATE",
+	[WMTakeFocus] = "WM_TAKE_FOCUS",
+};
+static const char *netnames[NetLast] = {
+	[NetSupported] = "_NET_SUPPORTED",
+	[NetWMName] = "_NET_WM_NAME",
+	[NetWMState] = "_NET_WM_STATE",
+	[NetWMFullscreen] = "_NET_WM_STATE_FULLSCREEN",
+	[NetActiveWindow] = "_NET_ACTIVE_WINDOW",
+	[NetWMWindowType] = "_NET_WM_WINDOW_TYPE",
+	[NetWMWindowTypeDialog] = "_NET_WM_WINDOW_TYPE_DIALOG",
+	[NetClientList] = "_NET_CLIENT_LIST",
+	[NetWMPing] = "_NET_WM_PING",
+	[NetWMPid] = "_NET_WM_PID",
+#ifdef XSYNC
+	[NetWMSyncRequest] = "_NET_WM_SYNC_REQUEST",
+	[NetWMSyncRequestCounter] = "_NET_WM_SYNC_REQUEST_COUNTER",
+#endif /* XSYNC */
+};
+static const char *xnames[XLast] = {
+	[Utf8String] = "UTF8_STRING",
+};
 static Bool running = True;
+static Bool restarting = False;
+static volatile sig_atomic_t reaped = False; /* a child exited, see prunepools() */
+static Bool benchmark = False;    /* -b: report the startup time and quit */
+static struct timespec started;
+static int restorefd = -1;   /* state left by the previous instance, see restart() */
+static Bool otherwm;
+static Bool utf8locale = False;
+static Bool bardirty = False;          /* a bar redraw has been requested */
+static long lastbar = 0;                /* time of the last redraw, in ms */
+static Bool arrangepending = False, restackpending = False;
+#ifdef XSYNC
+static Bool synced = False;             /* the SYNC extension is usable */
+static int syncevent, syncerror;        /* XSyncAlarmNotify event type, first error */
+static unsigned int nsyncwait = 0;      /* clients with a sync request in flight */
+#endif /* XSYNC */
+static unsigned long barrequests = 0, barredraws = 0;
+static unsigned long configthrottles = 0;
+static unsigned int nconfigwait = 0;    /* clients with a held back configure */
+static long nextping = 0;               /* when pingclients() has work again, -1 for never */
+static Client *pendingfocus = NULL;     /* entered by the pointer, see flushfocus() */
+static long entered = 0;                /* ... at this time, in ms */
+#ifdef IPC
+static int ipcfd = -1;                  /* listening socket */
+static int ipcreqfd = -1, ipcrepfd = -1; /* eventfds: requests for run(), replies for ipcthread() */
+static int ipcstop = 0;
+static Ring ipcreqs, ipcreplies, ipcevents;
+static int ipcsubs = 0;                 /* subscribed connections */
+static unsigned long ipclost = 0;       /* events the full ring turned away */
+static unsigned int ipcunsent = 0;      /* events ipcthread() was not woken for */
+static pthread_t ipcthr;
+static struct sockaddr_un ipcaddr;
+#endif /* IPC */
 static Cursor cursor[CurLast];
 static Display *dpy;
 static DC dc;
+static GC outlinegc;        /* xor outline of dragged clients */
+#ifdef SHM
+static Raster raster;
+static Bool shmerror;
+#endif /* SHM */
 static Monitor *mons = NULL;
+static ClientSlab **slabs = NULL;
+static unsigned int nslabs = 0;
+static Client *freeclients = NULL;  /* unused pool slots, linked through next */
+static Client *culprit = NULL;      /* client whose event is being handled */
+static Bool switching = False;       /* the switcher has the keyboard */
+static char query[64];              /* typed into the switcher, folded */
+static unsigned int querylen = 0;
+static Hit *hits = NULL;            /* clients matching query, best first */
+static unsigned int nhits = 0, hitsz = 0, hitsel = 0;
 static Window root;
 unsigned long bcolors[2];
 unsigned long tcolors[2][ColLast];
@@ -249,54 +704,154 @@ unsigned long scolors[MAXCOLORS][ColLast];
 
 struct Monitor {
 	char ltsymbol[16];
-	unsigned int lt[LENGTH(tags) + 1];
-	float mfact[LENGTH(tags) + 1];
-	int nmaster[LENGTH(tags) + 1];
+	Workspace **ws;       /* indexed by tag, allocated on demand */
+	unsigned int nws;
 	int by;               /* bar geometry */
 	int mx, my, mw, mh;   /* screen size */
 	int wx, wy, ww, wh;   /* window area  */
-    unsigned int curtag, prevtag;
+    unsigned int curtag, prevtag; /* curtag's workspace lends the layout */
+	TagSet view, prevview;
 	Client *clients;
 	Client *sel;
 	Client *stack;
 	Window barwin;
 };
 
+/* pooled clients by pool: waiting, launched but not mapped yet, and asked
+ * for by a spawn() that found none waiting */
+static unsigned int poolready[LENGTH(pools)];
+static unsigned int poolpending[LENGTH(pools)];
+static pid_t *poolpids[LENGTH(pools)]; /* of the poolpending launches */
+static unsigned int poolwant[LENGTH(pools)];
+
+#ifdef IPC
+static const Query queries[] = {
+	{ "resources",  queryresources },
+	{ "state",      querystate },
+	{ "subscribe",  querysubscribe },
+	{ "telemetry",  querytelemetry },
+};
+#endif /* IPC */
+
+/* x-ranges of the last drawn bar, left to right */
+static BarRegion *regions = NULL;
+static unsigned int nregions = 0, regionsz = 0;
+
 /* function implementations */
+void
+addregion(int x, unsigned int click, unsigned int arg) {
+	if(nregions >= regionsz) {
+		regionsz = regionsz ? regionsz * 2 : 64;
+		if(!(regions = realloc(regions, regionsz * sizeof *regions)))
+			die("fatal: could not malloc() %u bytes\n", regionsz * sizeof *regions);
+	}
+	if(nregions && x <= regions[nregions - 1].x)
+		return; /* empty range */
+	regions[nregions].x = x;
+	regions[nregions].click = click;
+	regions[nregions].arg = arg;
+	nregions++;
+}
+
+Client *
+allocclient(void) {
+	unsigned int i, idx;
+	ClientSlab *s;
+	Client *c;
+
+	if(!freeclients) {
+		if(!(slabs = realloc(slabs, (nslabs + 1) * sizeof(ClientSlab *)))
+		|| !(s = slabs[nslabs] = malloc(sizeof(ClientSlab))))
+			die("fatal: could not malloc() %u bytes\n", sizeof(ClientSlab));
+		for(i = POOLCHUNK; i--; ) {
+			s->hot[i].idx = nslabs * POOLCHUNK + i;
+			s->hot[i].next = freeclients;
+			freeclients = &s->hot[i];
+		}
+		nslabs++;
+	}
+	c = freeclients;
+	freeclients = c->next;
+	idx = c->idx;
+	memset(c, 0, sizeof(Client));
+	c->idx = idx;
+	memset(INFO(c), 0, sizeof(ClientInfo));
+	return c;
+}
+
+void
+addtag(const Arg *arg) {
+	if(mons->sel && arg->i >= 0 && arg->i < maxworkspaces) {
+		retag(mons->sel, arg->i, True);
+		notify("tag", mons->sel);
+		arrange();
+	}
+}
+
+/* Token bucket on the configure requests a client gets answered: up to
+ * configburst at once, then configrate per second. A request over the limit
+ * is held back and answered by flushconfigs() once a token is free, so a
+ * client fighting the layout only ever gets its latest answer. */
+Bool
+admitconfig(Client *c) {
+	long t, interval;
+
+	if(configrate <= 0) /* unthrottled */
+		return True;
+	t = now();
+	interval = 1000 / configrate;
+	if(INFO(c)->configtat - t > interval * (configburst - 1)) {
+		throttled(c);
+		if(!c->configwait) {
+			c->configwait = True;
+			nconfigwait++;
+		}
+		return False;
+	}
+	INFO(c)->configtat = MAX(INFO(c)->configtat, t) + interval;
+	return True;
+}
+
 void
 applyrules(Client *c) {
 	const char *class, *instance;
 	unsigned int i;
+	unsigned int t = 0;
 	const Rule *r;
 	XClassHint ch = { NULL, NULL };
 
 	/* rule matching */
-	c->isfloating = c->tag = 0;
+	c->isfloating = 0;
 	XGetClassHint(dpy, c->win, &ch);
 	class    = ch.res_class ? ch.res_class : broken;
 	instance = ch.res_name  ? ch.res_name  : broken;
+	strncpy(INFO(c)->class, class, sizeof INFO(c)->class - 1);
+	strncpy(INFO(c)->instance, instance, sizeof INFO(c)->instance - 1);
+	indexclient(c);
 
 	for(i = 0; i < LENGTH(rules); i++) {
 		r = &rules[i];
-		if((!r->title || strstr(c->name, r->title))
+		if((!r->title || strstr(INFO(c)->name, r->title))
 		&& (!r->class || strstr(class, r->class))
 		&& (!r->instance || strstr(instance, r->instance)))
 		{
 			c->isfloating = r->isfloating;
-			c->tag = (r->tag == 0) ? mons->curtag : r->tag - 1;
+			t = (r->tag == 0) ? mons->curtag : r->tag - 1;
 		}
 	}
 	if(ch.res_class)
 		XFree(ch.res_class);
 	if(ch.res_name)
 		XFree(ch.res_name);
-    if (c->tag == 0)
-        c->tag = mons->curtag;
+	if(t == 0)
+		t = mons->curtag;
+	settag(&c->tags, MIN(t, maxworkspaces - 1), True);
 }
 
 Bool
 applysizehints(Client *c, int *x, int *y, int *w, int *h, Bool interact) {
 	Bool baseismin;
+	ClientInfo *ci = INFO(c);
 
 	/* set minimum possible */
 	*w = MAX(1, *w);
@@ -327,41 +882,48 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, Bool interact) {
 		*w = bh;
 	if(resizehints || c->isfloating || curlayout.arrange == floating) {
 		/* see last two sentences in ICCCM 4.1.2.3 */
-		baseismin = c->basew == c->minw && c->baseh == c->minh;
+		baseismin = ci->basew == ci->minw && ci->baseh == ci->minh;
 		if(!baseismin) { /* temporarily remove base dimensions */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= ci->basew;
+			*h -= ci->baseh;
 		}
 		/* adjust for aspect limits */
-		if(c->mina > 0 && c->maxa > 0) {
-			if(c->maxa < (float)*w / *h)
-				*w = *h * c->maxa + 0.5;
-			else if(c->mina < (float)*h / *w)
-				*h = *w * c->mina + 0.5;
+		if(ci->mina > 0 && ci->maxa > 0) {
+			if(ci->maxa < (float)*w / *h)
+				*w = *h * ci->maxa + 0.5;
+			else if(ci->mina < (float)*h / *w)
+				*h = *w * ci->mina + 0.5;
 		}
 		if(baseismin) { /* increment calculation requires this */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= ci->basew;
+			*h -= ci->baseh;
 		}
 		/* adjust for increment value */
-		if(c->incw)
-			*w -= *w % c->incw;
-		if(c->inch)
-			*h -= *h % c->inch;
+		if(ci->incw)
+			*w -= *w % ci->incw;
+		if(ci->inch)
+			*h -= *h % ci->inch;
 		/* restore base dimensions */
-		*w = MAX(*w + c->basew, c->minw);
-		*h = MAX(*h + c->baseh, c->minh);
-		if(c->maxw)
-			*w = MIN(*w, c->maxw);
-		if(c->maxh)
-			*h = MIN(*h, c->maxh);
+		*w = MAX(*w + ci->basew, ci->minw);
+		*h = MAX(*h + ci->baseh, ci->minh);
+		if(ci->maxw)
+			*w = MIN(*w, ci->maxw);
+		if(ci->maxh)
+			*h = MIN(*h, ci->maxh);
 	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
 
 void
 arrange(void) {
+	if(culprit)
+		count(&INFO(culprit)->tm.arranges);
 	showhide(mons->stack);
+	if(suspended()) { /* only the fullscreen client is seen */
+		arrangepending = True;
+		return;
+	}
+	arrangepending = False;
    	strncpy(mons->ltsymbol, curlayout.symbol, sizeof mons->ltsymbol);
    	curlayout.arrange();
 	restack();
@@ -371,6 +933,7 @@ void
 attach(Client *c) {
 	c->next = mons->clients;
 	mons->clients = c;
+	fileclient(c);
 }
 
 void
@@ -379,29 +942,35 @@ attachstack(Client *c) {
 	mons->stack = c;
 }
 
+const BarRegion *
+barregion(int x) {
+	unsigned int lo = 0, hi = nregions, mid;
+
+	/* first region whose right edge lies beyond x */
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if(regions[mid].x <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < nregions ? &regions[lo] : NULL;
+}
+
 void
 buttonpress(XEvent *e) {
-	unsigned int i, x, click;
+	unsigned int i, click;
 	Arg arg = {0};
 	Client *c;
+	const BarRegion *r;
 	XButtonPressedEvent *ev = &e->xbutton;
 
 	click = ClkRootWin;
 	if(ev->window == mons->barwin) {
-		i = x = 0;
-		do
-			x += TEXTW(tags[i]);
-		while(ev->x >= x && ++i < LENGTH(tags));
-		if(i < LENGTH(tags)) {
-			click = ClkTagBar;
-			arg.ui = i;
-		}
-		else if(ev->x < x + blw)
-			click = ClkLtSymbol;
-		else if(ev->x > mons->ww - TEXTW(stext))
-			click = ClkStatusText;
-		else
-			click = ClkWinTitle;
+		if(!(r = barregion(ev->x)))
+			return;
+		click = r->click;
+		arg.ui = r->arg;
 	}
 	else if((c = wintoclient(ev->window))) {
 		focus(c);
@@ -410,35 +979,100 @@ buttonpress(XEvent *e) {
 	for(i = 0; i < LENGTH(buttons); i++)
 		if(click == buttons[i].click && buttons[i].func && buttons[i].button == ev->button
 		&& CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
-			buttons[i].func(click == ClkTagBar && buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
+			buttons[i].func((click == ClkTagBar || click == ClkStatusText)
+			                && buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
+	if(bardirty) /* user input is not paced */
+		drawbar();
+}
+
+#ifdef SHM
+/* length of the character at s in the encoding the font draws */
+int
+charlen(const char *s, int len) {
+	int n = 1;
+
+#ifdef XFT
+	if(dc.font.xft) /* UTF-8 */
+		for(; n < len && n < 4 && (s[n] & 0xc0) == 0x80; n++);
+	else
+#endif /* XFT */
+	if(dc.font.set)
+		n = mblen(s, len);
+	return MAX(n, 1);
 }
+#endif /* SHM */
 
 void
 checkotherwm(void) {
+	struct timespec ts = { 0, 10000000 };
+	int i;
+
 	xerrorxlib = XSetErrorHandler(xerrorstart);
 	/* this causes an error if some other window manager is running */
-	XSelectInput(dpy, DefaultRootWindow(dpy), SubstructureRedirectMask);
-	XSync(dpy, False);
+	for(i = 0; ; i++) {
+		otherwm = False;
+		XSelectInput(dpy, DefaultRootWindow(dpy), SubstructureRedirectMask);
+		XSync(dpy, False);
+		if(!otherwm)
+			break;
+		/* after a restart, the server may not have noticed yet that the
+		 * previous instance went away */
+		if(i == 100)
+			die("ldwm: another window manager is already running\n");
+		nanosleep(&ts, NULL);
+	}
 	XSetErrorHandler(xerror);
 	XSync(dpy, False);
 }
 
 void
 cleanup(void) {
+	Client *c;
+	unsigned int i;
+
+	for(c = mons->clients; c; c = c->next)
+		if(c->ispooled && !sendevent(c, wmatom[WMDelete]))
+			XKillClient(dpy, c->win);
 	while(mons->stack)
 		unmanage(mons->stack, False);
+#ifdef XFT
+	if(dc.font.xft) {
+		XftDrawDestroy(dc.xftdraw);
+		XftFontClose(dpy, dc.font.xft);
+	}
+	else
+#endif /* XFT */
 	if(dc.font.set)
 		XFreeFontSet(dpy, dc.font.set);
 	else
 		XFreeFont(dpy, dc.font.xfont);
 	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+#ifdef SHM
+	freeraster();
+#endif /* SHM */
+#ifdef IPC
+	freeipc();
+#endif /* IPC */
 	XFreePixmap(dpy, dc.drawable);
 	XFreeGC(dpy, dc.gc);
+	XFreeGC(dpy, outlinegc);
 	XFreeCursor(dpy, cursor[CurNormal]);
 	XFreeCursor(dpy, cursor[CurResize]);
 	XFreeCursor(dpy, cursor[CurMove]);
 	XUnmapWindow(dpy, mons->barwin);
 	XDestroyWindow(dpy, mons->barwin);
+	while(nslabs)
+		free(slabs[--nslabs]);
+	free(slabs);
+	free(regions);
+	free(hits);
+	for(i = 0; i < LENGTH(pools); i++)
+		free(poolpids[i]);
+	while(mons->nws)
+		freews(mons->ws[--mons->nws]);
+	free(mons->ws);
+	free(mons->view.more);
+	free(mons->prevview.more);
 	free(mons);
 	XSync(dpy, False);
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
@@ -449,17 +1083,35 @@ void
 clientmessage(XEvent *e) {
 	XClientMessageEvent *cme = &e->xclient;
 	Client *c = wintoclient(cme->window);
-
+	Arg a;
+
+	if(cme->window == root && cme->message_type == wmatom[WMProtocols]
+	&& (Atom)cme->data.l[0] == netatom[NetWMPing]) { /* a pong */
+		if((c = wintoclient(cme->data.l[2]))) {
+			c->pingwait = False;
+			if(c->ishung) {
+				c->ishung = False;
+				if(c == mons->sel)
+					requestbar();
+			}
+		}
+		return;
+	}
 	if(!c)
 		return;
+	culprit = c;
 	if(cme->message_type == netatom[NetWMState]) {
 		if(cme->data.l[1] == netatom[NetWMFullscreen] || cme->data.l[2] == netatom[NetWMFullscreen])
 			setfullscreen(c, (cme->data.l[0] == 1 /* _NET_WM_STATE_ADD    */
 			              || (cme->data.l[0] == 2 /* _NET_WM_STATE_TOGGLE */ && !c->isfullscreen)));
 	}
 	else if(cme->message_type == netatom[NetActiveWindow]) {
-		if(!ISVISIBLE(c))
-			mons->curtag = c->tag;
+		if(c->ispooled)
+			unpool(c);
+		else if(!ISVISIBLE(c)) {
+			a.i = nexttag(&c->tags, 0);
+			view(&a);
+		}
 		pop(c);
 	}
 }
@@ -480,6 +1132,21 @@ configure(Client *c) {
 	ce.above = None;
 	ce.override_redirect = False;
 	XSendEvent(dpy, c->win, False, StructureNotifyMask, (XEvent *)&ce);
+	setsent(c);
+}
+
+void
+configureclient(Client *c) {
+	XWindowChanges wc;
+
+	wc.x = c->x;
+	wc.y = c->y;
+	wc.width = c->w;
+	wc.height = c->h;
+	wc.border_width = c->bw;
+	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
+	configure(c);
+	XSync(dpy, False);
 }
 
 void
@@ -496,8 +1163,16 @@ configurenotify(XEvent *e) {
 			if(dc.drawable != 0)
 				XFreePixmap(dpy, dc.drawable);
 			dc.drawable = XCreatePixmap(dpy, root, sw, bh, DefaultDepth(dpy, screen));
+#ifdef XFT
+			if(dc.xftdraw)
+				XftDrawChange(dc.xftdraw, dc.drawable);
+#endif /* XFT */
 			updatebars();
 			XMoveResizeWindow(dpy, mons->barwin, mons->wx, mons->by, mons->ww, bh);
+#ifdef SHM
+			freeraster();
+			initraster();
+#endif /* SHM */
 			focus(NULL);
 			arrange();
 		}
@@ -507,12 +1182,28 @@ configurenotify(XEvent *e) {
 void
 configurerequest(XEvent *e) {
 	Client *c;
-	XConfigureRequestEvent *ev = &e->xconfigurerequest;
+	XConfigureRequestEvent *ev = &e->xconfigurerequest, *last;
 	XWindowChanges wc;
 
 	if((c = wintoclient(ev->window))) {
-		if(ev->value_mask & CWBorderWidth)
+		culprit = c;
+		count(&INFO(c)->tm.configs);
+		last = &INFO(c)->lastreq;
+		if(ev->value_mask == last->value_mask && ev->x == last->x && ev->y == last->y
+		&& ev->width == last->width && ev->height == last->height
+		&& ev->border_width == last->border_width && !c->configwait
+		&& c->x == INFO(c)->sentx && c->y == INFO(c)->senty && c->w == INFO(c)->sentw
+		&& c->h == INFO(c)->senth && c->bw == INFO(c)->sentbw) {
+			/* the same request again, and its answer still holds */
+			if(admitconfig(c))
+				configure(c);
+			return;
+		}
+		*last = *ev;
+		if(ev->value_mask & CWBorderWidth) {
 			c->bw = ev->border_width;
+			reindex(c);
+		}
 		else if(c->isfloating || curlayout.arrange == floating) {
 			if(ev->value_mask & CWX) {
 				c->oldx = c->x;
@@ -534,12 +1225,17 @@ configurerequest(XEvent *e) {
 				c->x = mons->mx + (mons->mw / 2 - WIDTH(c) / 2); /* center in x direction */
 			if((c->y + c->h) > mons->my + mons->mh && c->isfloating)
 				c->y = mons->my + (mons->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
+			reindex(c);
+			if(!admitconfig(c))
+				return;
 			if((ev->value_mask & (CWX|CWY)) && !(ev->value_mask & (CWWidth|CWHeight)))
 				configure(c);
-			if(ISVISIBLE(c))
+			if(ISVISIBLE(c)) {
 				XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+				setsent(c);
+			}
 		}
-		else
+		else if(admitconfig(c))
 			configure(c);
 	}
 	else {
@@ -552,27 +1248,56 @@ configurerequest(XEvent *e) {
 		wc.stack_mode = ev->detail;
 		XConfigureWindow(dpy, ev->window, ev->value_mask, &wc);
 	}
-	XSync(dpy, False);
+}
+
+void
+count(Counter *k) {
+	long t = now();
+
+	k->rate = (decayed(k, t)) + 256;
+	k->total++;
+	k->last = t;
+}
+
+/* Counts a property change, keeping apart the PROPSLOTS busiest atoms: an
+ * atom not seen yet takes the slot with the lowest rate. */
+void
+countprop(Client *c, Atom atom) {
+	Telemetry *tm = &INFO(c)->tm;
+	unsigned int i, min = 0;
+	long t = now();
+
+	count(&tm->props);
+	for(i = 0; i < PROPSLOTS && tm->prop[i].atom != atom; i++)
+		if(decayed(&tm->prop[i].k, t) < decayed(&tm->prop[min].k, t))
+			min = i;
+	if(i == PROPSLOTS) {
+		i = min;
+		memset(&tm->prop[i], 0, sizeof tm->prop[i]);
+		tm->prop[i].atom = atom;
+	}
+	count(&tm->prop[i].k);
 }
 
 Monitor *
 createmon(void) {
 	Monitor *m;
-    int i;
 
 	if(!(m = (Monitor *)calloc(1, sizeof(Monitor))))
 		die("fatal: could not malloc() %u bytes\n", sizeof(Monitor));
 	m->curtag = m->prevtag = 0;
-    /* from config.h */
-    for(i=0; i < LENGTH(tags); i++) {
-        m->nmaster[i] = nmaster;
-        m->mfact[i] = mfact;
-        m->lt[i] = 0;
-    }
-	strncpy(m->ltsymbol, layouts[m->lt[m->curtag]].symbol, sizeof m->ltsymbol);
 	return m;
 }
 
+/* Returns the rate of k at time t: hits count 256 and are halved for
+ * each RATEHALFLIFE boundary passed since. */
+unsigned long
+decayed(const Counter *k, long t) {
+	long n = t / RATEHALFLIFE - k->last / RATEHALFLIFE;
+
+	return n >= (long)sizeof(k->rate) * 8 ? 0 : k->rate >> n;
+}
+
 void
 destroynotify(XEvent *e) {
 	Client *c;
@@ -585,9 +1310,15 @@ destroynotify(XEvent *e) {
 void
 detach(Client *c) {
 	Client **tc;
+	int t;
 
 	for(tc = &mons->clients; *tc && *tc != c; tc = &(*tc)->next);
 	*tc = c->next;
+	for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1)) {
+		mons->ws[t]->nclients--;
+		fileedges(mons->ws[t], c, False);
+	}
+	c->isindexed = False;
 }
 
 void
@@ -615,50 +1346,79 @@ die(const char *errstr, ...) {
 
 void
 drawbar(void) {
-	int x;
-	unsigned int i, occ = 0;
+	int x, sx;
+	unsigned int i;
 	unsigned long *col;
-	Client *c;
-	for(c = mons->clients; c; c = c->next)
-		occ |= 1 << c->tag;
+	const char *label;
+	char buf[sizeof ((ClientInfo *)0)->name + sizeof hung];
+#ifdef SHM
+	if(raster.busy) { /* the server still reads the last frame */
+		bardirty = True;
+		return;
+	}
+#endif /* SHM */
+	if(suspended() && !switching) { /* the bar is covered */
+		bardirty = True;
+		return;
+	}
+	bardirty = False;
+	lastbar = now();
+	barredraws++;
+	nregions = 0;
 	dc.x = 0;
-	for(i = 0; i < LENGTH(tags); i++) {
-		dc.w = TEXTW(tags[i]);
-		col = tcolors[(mons->curtag == i)];
-		drawtext(tags[i], col, True);
-		drawsquare(mons->sel && mons->sel->tag == i, occ & (1 << i), col);
+	for(i = 0; i < MAX(mons->nws, LENGTH(tags)); i++) {
+		if(!occupied(i) && !hastag(&mons->view, i) && (i >= LENGTH(tags) || hidevacant))
+			continue;
+		label = tagname(i);
+		dc.w = TEXTW(label);
+		col = tcolors[hastag(&mons->view, i)];
+		drawtext(label, col, True);
+		drawsquare(mons->sel && hastag(&mons->sel->tags, i), occupied(i), col);
 		dc.x += dc.w;
+		addregion(dc.x, ClkTagBar, i);
 	}
-	dc.w = blw = TEXTW(mons->ltsymbol);
+	dc.w = TEXTW(mons->ltsymbol);
 	drawtext(mons->ltsymbol, tcolors[0], True);
 	dc.x += dc.w;
+	addregion(dc.x, ClkLtSymbol, 0);
 	x = dc.x;
-	dc.w = textnw(stext, strlen(stext));
-	dc.x = mons->ww - dc.w;
-	if(dc.x < x) {
-		dc.x = x;
-		dc.w = mons->ww - x;
-	}
-	drawcoloredtext(stext);
-    /* client titles */
-	if((dc.w = dc.x - x) > bh) {
-		dc.x = x;
-		if(mons->sel) {
+	sx = switching ? mons->ww : MAX(x, mons->ww - textnw(stext, strlen(stext)));
+	/* client titles */
+	if((dc.w = sx - x) > bh) {
+		if(switching)
+			drawswitcher();
+		else if(mons->sel) {
 			col = tcolors[1];
-			drawtext(mons->sel->name, col, True);
+			refreshtitle(mons->sel);
+			if(mons->sel->ishung) {
+				snprintf(buf, sizeof buf, "%s%s", INFO(mons->sel)->name, hung);
+				drawtext(buf, col, True);
+			}
+			else
+				drawtext(INFO(mons->sel)->name, col, True);
 			drawsquare(mons->sel->isfixed, mons->sel->isfloating, col);
 		}
 		else
 			drawtext(NULL, tcolors[0], False);
 	}
+	addregion(sx, ClkWinTitle, 0);
+	dc.x = sx;
+	dc.w = mons->ww - sx;
+	drawcoloredtext(stext);
+#ifdef SHM
+	if(raster.on) {
+		flushraster();
+		return;
+	}
+#endif /* SHM */
 	XCopyArea(dpy, dc.drawable, mons->barwin, dc.gc, 0, 0, mons->ww, bh, 0, 0);
-	XSync(dpy, False);
 }
 
 void
 drawcoloredtext(char *text) {
 	char *buf = text, *ptr = text;
 	unsigned long *col = scolors[0];
+	unsigned int seg = 0;
 	int i, ox = dc.x;
 
 	while(*ptr) {
@@ -668,68 +1428,202 @@ drawcoloredtext(char *text) {
 			dc.w = mons->ww - dc.x;
 			drawtext(buf, col, False);
 			dc.x += textnw(buf, i);
+			addregion(dc.x, ClkStatusText, seg++);
         }
 		col = scolors[ *ptr-1 ];
 		buf = ++ptr;
 	}
 	drawtext(buf, col, False);
+	addregion(mons->ww, ClkStatusText, seg);
 	dc.x = ox;
 }
 
+void
+drawoutline(Client *c, int x, int y, int w, int h) {
+	/* drawing the same outline twice erases it */
+	XDrawRectangle(dpy, root, outlinegc, x, y, w + 2 * c->bw - 1, h + 2 * c->bw - 1);
+}
+
+void
+drawrect(int x, int y, int w, int h, Bool filled, unsigned long pixel) {
+#ifdef SHM
+	int i, j, stride;
+	unsigned int *p;
+
+	if(raster.on) {
+		if(!filled) {
+			drawrect(x, y, w, 1, True, pixel);
+			drawrect(x, y + h - 1, w, 1, True, pixel);
+			drawrect(x, y, 1, h, True, pixel);
+			drawrect(x + w - 1, y, 1, h, True, pixel);
+			return;
+		}
+		if(x < 0) { w += x; x = 0; }
+		if(y < 0) { h += y; y = 0; }
+		w = MIN(w, raster.img->width - x);
+		h = MIN(h, raster.img->height - y);
+		stride = raster.img->bytes_per_line / 4;
+		for(j = 0; j < h; j++)
+			for(i = 0, p = (unsigned int *)raster.img->data + (y + j) * stride + x; i < w; i++)
+				p[i] = pixel;
+		return;
+	}
+#endif /* SHM */
+	XSetForeground(dpy, dc.gc, pixel);
+	if(filled)
+		XFillRectangle(dpy, dc.drawable, dc.gc, x, y, w, h);
+	else
+		XDrawRectangle(dpy, dc.drawable, dc.gc, x, y, w - 1, h - 1);
+}
+
 void
 drawsquare(Bool filled, Bool empty, unsigned long col[ColLast]) {
 	int x;
-	XSetForeground(dpy, dc.gc, col[ ColFG ]);
 	x = (dc.font.ascent + dc.font.descent + 2) / 4;
 	if(filled)
-		XFillRectangle(dpy, dc.drawable, dc.gc, dc.x+1, dc.y+1, x+1, x+1);
+		drawrect(dc.x+1, dc.y+1, x+1, x+1, True, col[ ColFG ]);
 	else if(empty)
-		XDrawRectangle(dpy, dc.drawable, dc.gc, dc.x+1, dc.y+1, x, x);
+		drawrect(dc.x+1, dc.y+1, x+1, x+1, False, col[ ColFG ]);
+}
+
+void
+drawstring(int x, int y, const char *text, int len, unsigned long pixel) {
+#ifdef SHM
+	int i, j, n, a, stride;
+	unsigned int *p, bg;
+	RasterGlyph *g;
+
+	if(raster.on) {
+		/* glyph rows line up with bar rows, see getglyph() */
+		stride = raster.img->bytes_per_line / 4;
+		for(; len > 0 && x < raster.img->width; text += n, len -= n, x += g->w) {
+			n = charlen(text, len);
+			if(!(g = getglyph(text, n)))
+				break;
+			for(j = 0; j < raster.img->height; j++)
+				for(i = MAX(0, -x); i < g->w && x + i < raster.img->width; i++) {
+					if(!(a = g->alpha[j * g->w + i]))
+						continue;
+					p = (unsigned int *)raster.img->data + j * stride + x + i;
+					bg = *p;
+					*p = BLEND(bg, pixel, a, raster.rshift)
+					   | BLEND(bg, pixel, a, raster.gshift)
+					   | BLEND(bg, pixel, a, raster.bshift);
+				}
+		}
+		return;
+	}
+#endif /* SHM */
+#ifdef XFT
+	if(dc.font.xft) {
+		XftColor fg;
+
+		xftcolor(pixel, &fg);
+		XftDrawStringUtf8(dc.xftdraw, &fg, dc.font.xft, x, y, (XftChar8 *)text, len);
+		return;
+	}
+#endif /* XFT */
+	XSetForeground(dpy, dc.gc, pixel);
+	if(dc.font.set)
+		XmbDrawString(dpy, dc.drawable, dc.font.set, dc.gc, x, y, text, len);
+	else
+		XDrawString(dpy, dc.drawable, dc.gc, x, y, text, len);
+}
+
+/* Draws the query and as many hits as fit, from the one starting the
+ * stretch hitsel is on, across dc.x to dc.x + dc.w. */
+void
+drawswitcher(void) {
+	int x = dc.x, end = dc.x + dc.w, w;
+	unsigned int i, first = 0;
+
+	dc.w = MIN(MAX(textnw(query, querylen), bh * 4) + dc.font.height, (end - x) / 4);
+	drawtext(query, tcolors[0], True);
+	dc.x += dc.w;
+	for(i = 0, w = 0; i <= hitsel && i < nhits; i++)
+		if((w += MIN((int)TEXTW(INFO(hits[i].c)->name), (end - x) / 3)) > end - dc.x) {
+			first = i;
+			w = MIN((int)TEXTW(INFO(hits[i].c)->name), (end - x) / 3);
+		}
+	for(i = first; i < nhits && dc.x < end; i++) {
+		dc.w = MIN(MIN((int)TEXTW(INFO(hits[i].c)->name), (end - x) / 3), end - dc.x);
+		drawtext(INFO(hits[i].c)->name, tcolors[i == hitsel], True);
+		dc.x += dc.w;
+	}
+	if((dc.w = end - dc.x) > 0)
+		drawtext(NULL, tcolors[0], False);
+	dc.x = x;
 }
 
 void
 drawtext(const char *text, unsigned long col[ColLast], Bool pad) {
 	char buf[256];
-	int i, x, y, h, len, olen;
+	int i, j, x, y, h, len, olen;
+	Bool utf8 = dc.font.set && utf8locale;
 
-	XSetForeground(dpy, dc.gc, col[ ColBG ]);
-	XFillRectangle(dpy, dc.drawable, dc.gc, dc.x, dc.y, dc.w, dc.h);
+#ifdef XFT
+	utf8 = utf8 || dc.font.xft;
+#endif /* XFT */
+	drawrect(dc.x, dc.y, dc.w, dc.h, True, col[ ColBG ]);
 	if(!text)
 		return;
 	olen = strlen(text);
 	h = pad ? (dc.font.ascent + dc.font.descent) : 0;
 	y = dc.y + ((dc.h + dc.font.ascent - dc.font.descent) / 2);
 	x = dc.x + (h / 2);
-	/* shorten text if necessary */
-	for(len = MIN(olen, sizeof buf); len && textnw(text, len) > dc.w - h; len--);
+	/* shorten text if necessary, cutting between characters only */
+	for(len = MIN(olen, sizeof buf); len && ((utf8 && (text[len] & 0xc0) == 0x80)
+	|| textnw(text, len) > dc.w - h); len--);
 	if(!len)
 		return;
 	memcpy(buf, text, len);
-	if(len < olen)
-		for(i = len; i && i > len - 3; buf[--i] = '.');
-	XSetForeground(dpy, dc.gc, col[ ColFG ]);
-	if(dc.font.set)
-		XmbDrawString(dpy, dc.drawable, dc.font.set, dc.gc, x, y, buf, len);
-	else
-		XDrawString(dpy, dc.drawable, dc.gc, x, y, buf, len);
+	if(len < olen) {
+		for(j = MAX(len - 3, 0); j && utf8 && (text[j] & 0xc0) == 0x80; j--);
+		for(i = j, len = MIN(j + 3, len); i < len; buf[i++] = '.');
+	}
+	drawstring(x, y, buf, len, col[ ColFG ]);
 }
 
 
+/* Returns the index of the first of the n edges at pos or past it. */
+unsigned int
+edgesearch(const Edge *e, unsigned int n, int pos) {
+	unsigned int lo = 0, mid;
+
+	while(lo < n) {
+		mid = lo + (n - lo) / 2;
+		if(e[mid].pos < pos)
+			lo = mid + 1;
+		else
+			n = mid;
+	}
+	return lo;
+}
+
 void
 enternotify(XEvent *e) {
-    XCrossingEvent *ev = &e->xcrossing;
-    Client *c = wintoclient(ev->window);
-    if (((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root)
-    || (!c || c == mons->sel))
-        return;
-    else
-        focus(c);
+	XCrossingEvent *ev = &e->xcrossing;
+	Client *c;
+
+	if(ev->window == root || ev->window == mons->barwin) { /* no longer resting in a client */
+		pendingfocus = NULL;
+		return;
+	}
+	if(ev->mode != NotifyNormal || ev->detail == NotifyInferior || !(c = wintoclient(ev->window)))
+		return;
+	/* a sweep across many windows only focuses the one it ends in */
+	pendingfocus = c == mons->sel ? NULL : c;
+	entered = now();
 }
 
 void
 expose(XEvent *e) {
-    if((&e->xexpose)->count == 0)
-        drawbar();
+    if((&e->xexpose)->count == 0) {
+#ifdef SHM
+        raster.full = True;
+#endif /* SHM */
+        requestbar();
+    }
 }
 
 void
@@ -737,8 +1631,94 @@ floating(void) {
     return; /* no behavior */
 }
 
+/* Counts c on the workspaces of its tags and files its sides in their edge
+ * index, once it joined the client list. */
+void
+fileclient(Client *c) {
+	int t;
+
+	INFO(c)->ix = c->x;
+	INFO(c)->iy = c->y;
+	INFO(c)->iw = WIDTH(c);
+	INFO(c)->ih = HEIGHT(c);
+	c->isindexed = True;
+	for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1)) {
+		getws(t)->nclients++;
+		fileedges(mons->ws[t], c, True);
+	}
+}
+
+/* Adds (on) or removes the sides of c, at its filed geometry, to or from the
+ * edge lists of ws. Kept sorted so that snapping and placement only look at
+ * windows near the position in question. */
+void
+fileedges(Workspace *ws, Client *c, Bool on) {
+	ClientInfo *ci = INFO(c);
+	int side[2][2] = { { ci->ix, ci->ix + ci->iw }, { ci->iy, ci->iy + ci->ih } };
+	unsigned int a, i, j, n = ws->nedges;
+	Edge *e;
+
+	if(on && ws->nedges + 2 > ws->edgesz) {
+		ws->edgesz = ws->edgesz ? ws->edgesz * 2 : 16;
+		if(!(ws->xedges = realloc(ws->xedges, ws->edgesz * sizeof(Edge)))
+		|| !(ws->yedges = realloc(ws->yedges, ws->edgesz * sizeof(Edge))))
+			die("fatal: could not malloc() %u bytes\n", ws->edgesz * sizeof(Edge));
+	}
+	for(a = 0; a < 2; a++) {
+		e = a ? ws->yedges : ws->xedges;
+		n = ws->nedges;
+		for(j = 0; j < 2; j++) {
+			i = edgesearch(e, n, side[a][j]);
+			if(on) {
+				memmove(e + i + 1, e + i, (n - i) * sizeof *e);
+				e[i].pos = side[a][j];
+				e[i].c = c;
+				n++;
+				continue;
+			}
+			for(; i < n && e[i].pos == side[a][j] && e[i].c != c; i++);
+			if(i < n && e[i].c == c) {
+				memmove(e + i, e + i + 1, (n - i - 1) * sizeof *e);
+				n--;
+			}
+		}
+	}
+	ws->nedges = n;
+}
+
+void
+fillpool(unsigned int i) {
+	pid_t pid;
+
+	while(poolready[i] + poolpending[i] < pools[i].n + poolwant[i]) {
+		if((pid = launch(pools[i].cmd)) < 0)
+			return;
+		if(!(poolpids[i] = realloc(poolpids[i], (poolpending[i] + 1) * sizeof(pid_t))))
+			die("fatal: could not malloc() %u bytes\n", (poolpending[i] + 1) * sizeof(pid_t));
+		poolpids[i][poolpending[i]++] = pid;
+	}
+}
+
+/* Queries the core font initfont() only asked the server to open; its
+ * BadName, if any, has been ignored by xerror() meanwhile. */
+void
+finishfont(const char *fontstr) {
+	if(!dc.font.fid)
+		return;
+	if(!(dc.font.xfont = XQueryFont(dpy, dc.font.fid))
+	&& !(dc.font.xfont = XLoadQueryFont(dpy, "fixed")))
+		die("error, cannot load font: '%s'\n", fontstr);
+	dc.font.fid = 0;
+	dc.font.ascent = dc.font.xfont->ascent;
+	dc.font.descent = dc.font.xfont->descent;
+	dc.font.height = dc.font.ascent + dc.font.descent;
+}
+
 void
 focus(Client *c) {
+	static Window focused; /* as last told to subscribers */
+
+	pendingfocus = NULL; /* clicks and keys win over the pointer resting */
 	if(!c || !ISVISIBLE(c))
 		for(c = mons->stack; c && !ISVISIBLE(c); c = c->snext);
 	if(mons->sel && mons->sel != c)
@@ -756,30 +1736,123 @@ focus(Client *c) {
 		XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
 	}
 	mons->sel = c;
-    drawbar();
+	if((c ? c->win : None) != focused) {
+		focused = c ? c->win : None;
+		notify("focus", c);
+	}
+	requestbar();
 }
 
-void
-focusin(XEvent *e) { /* there are some broken focus acquiring clients */
-	XFocusChangeEvent *ev = &e->xfocus;
+long
+flushbar(void) {
+	long wait;
 
-	if(mons->sel && ev->window != mons->sel->win)
-		setfocus(mons->sel);
+	if(!bardirty)
+		return -1;
+	if((wait = lastbar + barinterval - now()) > 0)
+		return wait;
+	drawbar();
+	return -1;
 }
 
-void
-focusstack(const Arg *arg) {
-	Client *c = NULL, *i;
+/* Answers held back configure requests whose bucket has a token again and
+ * returns the ms until the next one is due, or -1 if none is left. */
+long
+flushconfigs(void) {
+	long t = now(), due, wait = -1, interval = configrate > 0 ? 1000 / configrate : 0;
+	Client *c;
 
-	if(!mons->sel)
-		return;
-	if(arg->i > 0) {
-		for(c = mons->sel->next; c && !ISVISIBLE(c); c = c->next);
-		if(!c)
-			for(c = mons->clients; c && !ISVISIBLE(c); c = c->next);
+	for(c = mons->clients; c && nconfigwait; c = c->next) {
+		if(!c->configwait)
+			continue;
+		if((due = INFO(c)->configtat - interval * (configburst - 1)) > t) {
+			if(wait < 0 || due - t < wait)
+				wait = due - t;
+			continue;
+		}
+		c->configwait = False;
+		nconfigwait--;
+		INFO(c)->configtat = MAX(INFO(c)->configtat, t) + interval;
+		if((c->isfloating || curlayout.arrange == floating) && ISVISIBLE(c))
+			XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+		configure(c);
 	}
-	else {
-		for(i = mons->clients; i != mons->sel; i = i->next)
+	return wait;
+}
+
+#ifdef SHM
+/* uploads the columns that changed since the last frame */
+void
+flushraster(void) {
+	int x, y, x0, gap, last = -1, w = raster.img->width, h = raster.img->height;
+	int stride = raster.img->bytes_per_line / 4;
+	unsigned int *cur = (unsigned int *)raster.img->data;
+
+	memset(raster.cols, raster.full, w);
+	if(!raster.full)
+		for(y = 0; y < h; y++)
+			for(x = 0; x < w; x++)
+				if(cur[y * stride + x] != raster.prev[y * w + x])
+					raster.cols[x] = 1;
+	raster.full = False;
+	for(x = 0; x < w; x++)
+		if(raster.cols[x])
+			last = x;
+	for(x = 0; x <= last; x++) {
+		if(!raster.cols[x])
+			continue;
+		/* a span ends after SPANGAP clean columns */
+		for(x0 = x, gap = 0; x <= last && gap < SPANGAP; x++)
+			gap = raster.cols[x] ? 0 : gap + 1;
+		x -= gap;
+		for(y = 0; y < h; y++)
+			memcpy(raster.prev + y * w + x0, cur + y * stride + x0, (x - x0) * sizeof *cur);
+		if(raster.shm) {
+			XShmPutImage(dpy, mons->barwin, dc.gc, raster.img, x0, 0, x0, 0, x - x0, h, x > last);
+			raster.busy = x > last;
+		}
+		else
+			XPutImage(dpy, mons->barwin, dc.gc, raster.img, x0, 0, x0, 0, x - x0, h);
+	}
+}
+#endif /* SHM */
+
+#ifdef IPC
+/* Wakes ipcthread() for the events notify() queued since the last call. */
+void
+flushevents(void) {
+	uint64_t n = ipcunsent;
+
+	if(n && write(ipcrepfd, &n, sizeof n) != sizeof n)
+		perror("ldwm: ipc");
+	ipcunsent = 0;
+}
+#endif /* IPC */
+
+void
+focusin(XEvent *e) { /* there are some broken focus acquiring clients */
+	XFocusChangeEvent *ev = &e->xfocus;
+
+	if(mons->sel && ev->window != mons->sel->win) {
+		if((culprit = wintoclient(ev->window)))
+			count(&INFO(culprit)->tm.steals);
+		setfocus(mons->sel);
+	}
+}
+
+void
+focusstack(const Arg *arg) {
+	Client *c = NULL, *i;
+
+	if(!mons->sel)
+		return;
+	if(arg->i > 0) {
+		for(c = mons->sel->next; c && !ISVISIBLE(c); c = c->next);
+		if(!c)
+			for(c = mons->clients; c && !ISVISIBLE(c); c = c->next);
+	}
+	else {
+		for(i = mons->clients; i != mons->sel; i = i->next)
 			if(ISVISIBLE(i))
 				c = i;
 		if(!c)
@@ -793,6 +1866,126 @@ focusstack(const Arg *arg) {
 	}
 }
 
+void
+freeclient(Client *c) {
+	free(c->tags.more);
+	c->next = freeclients;
+	freeclients = c;
+}
+
+void
+freews(Workspace *ws) {
+	if(!ws)
+		return;
+	free(ws->xedges);
+	free(ws->yedges);
+	free(ws);
+}
+
+#ifdef IPC
+void
+freeipc(void) {
+	IpcEvent *ev;
+	IpcRequest *req;
+	IpcReply *rep;
+	uint64_t one = 1;
+
+	if(ipcfd < 0)
+		return;
+	__atomic_store_n(&ipcstop, 1, __ATOMIC_RELEASE);
+	if(write(ipcrepfd, &one, sizeof one) != sizeof one)
+		return;
+	pthread_join(ipcthr, NULL);
+	while((ev = ringget(&ipcevents))) { /* never handed out */
+		free(ev->text);
+		free(ev);
+	}
+	while((req = ringget(&ipcreqs)))
+		free(req);
+	while((rep = ringget(&ipcreplies))) {
+		free(rep->text);
+		free(rep);
+	}
+	close(ipcfd);
+	close(ipcreqfd);
+	close(ipcrepfd);
+	unlink(ipcaddr.sun_path);
+}
+#endif /* IPC */
+
+/* Focuses the client the pointer entered once it stayed there for
+ * focusdelay ms and returns the ms left until then, or -1 if none is due. */
+long
+flushfocus(void) {
+	long left;
+
+	if(!pendingfocus)
+		return -1;
+	if(!ISVISIBLE(pendingfocus)) {
+		pendingfocus = NULL;
+		return -1;
+	}
+	if((left = entered + focusdelay - now()) > 0)
+		return left;
+	focus(pendingfocus);
+	return -1;
+}
+
+#ifdef SHM
+void
+flushglyphs(void) {
+	unsigned int i;
+
+	for(i = 0; i < GLYPHCACHE; i++) {
+		free(raster.glyphs[i].alpha);
+		raster.glyphs[i].alpha = NULL;
+		raster.glyphs[i].key = 0;
+	}
+	raster.nglyphs = 0;
+}
+
+void
+freeraster(void) {
+	flushglyphs();
+	if(raster.img) {
+		if(raster.shm) {
+			XShmDetach(dpy, &raster.info);
+			XSync(dpy, False);
+			shmdt(raster.info.shmaddr);
+			raster.img->data = NULL;
+		}
+		XDestroyImage(raster.img);
+	}
+	free(raster.prev);
+	free(raster.cols);
+	raster.img = NULL;
+	raster.prev = NULL;
+	raster.cols = NULL;
+	raster.on = raster.shm = raster.busy = False;
+}
+#endif /* SHM */
+
+/* Returns how well the folded q matches s as a subsequence, lower is
+ * better, or -1 if it does not: the earliest match is tightened from its
+ * end backwards, then every skipped byte and a start inside a word cost. */
+int
+fuzzy(const char *s, const char *q, unsigned int len) {
+	int i, j, start, end;
+
+	for(i = j = 0; s[i] && j < (int)len; i++)
+		if(tolower((unsigned char)s[i]) == q[j])
+			j++;
+	if(j < (int)len)
+		return -1;
+	if(!len)
+		return 0;
+	for(end = i - 1, j = len - 1; j >= 0; i--)
+		if(tolower((unsigned char)s[i - 1]) == q[j])
+			j--;
+	start = i;
+	return (end - start + 1 - len) * 2 + (start && isalnum((unsigned char)s[start - 1]));
+}
+
 Atom
 getatomprop(Client *c, Atom prop) {
 	int di;
@@ -811,8 +2004,21 @@ getatomprop(Client *c, Atom prop) {
 unsigned long
 getcolor(const char *colstr) {
 	Colormap cmap = DefaultColormap(dpy, screen);
+	Visual *v = DefaultVisual(dpy, screen);
+	unsigned long rgb, mask[3] = { v->red_mask, v->green_mask, v->blue_mask }, m, pixel = 0;
 	XColor color;
-
+	char *end;
+	int i, shift;
+
+	/* #rrggbb maps onto the visual's masks directly, no round-trip needed */
+	if(v->class == TrueColor && colstr[0] == '#' && strlen(colstr) == 7
+	&& (rgb = strtoul(colstr + 1, &end, 16), !*end)) {
+		for(i = 0; i < 3; i++) {
+			for(shift = 0, m = mask[i]; m && !(m & 1); m >>= 1, shift++);
+			pixel |= ((rgb >> (16 - 8 * i) & 0xff) * m / 255) << shift;
+		}
+		return pixel;
+	}
 	if(!XAllocNamedColor(dpy, cmap, colstr, &color, &color))
 		die("error, cannot allocate color '%s'\n", colstr);
 	return color.pixel;
@@ -838,31 +2044,118 @@ getstate(Window w) {
 Bool
 gettextprop(Window w, Atom atom, char *text, unsigned int size) {
 	char **list = NULL;
-	int n;
+	int n, format;
+	unsigned long len, extra;
+	unsigned char *p = NULL;
+	Atom type;
 	XTextProperty name;
 
 	if(!text || size == 0)
 		return False;
 	text[0] = '\0';
-	XGetTextProperty(dpy, w, &name, atom);
-	if(!name.nitems)
+	/* only transfer what fits into text; long_length counts 32-bit units */
+	if(XGetWindowProperty(dpy, w, atom, 0L, (size + 3) / 4, False, AnyPropertyType,
+	                      &type, &format, &len, &extra, &p) != Success || !p)
 		return False;
-	if(name.encoding == XA_STRING)
-		strncpy(text, (char *)name.value, size - 1);
-	else {
-		if(XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
-			strncpy(text, *list, size - 1);
+	if(!len || format != 8) {
+		XFree(p);
+		return False;
+	}
+	if(type == XA_STRING || (type == xatom[Utf8String] && utf8locale)) {
+		if(len > size - 1) {
+			len = size - 1;
+			/* do not cut a multibyte sequence in half */
+			if(type == xatom[Utf8String])
+				while(len && (p[len] & 0xc0) == 0x80)
+					len--;
+		}
+		memcpy(text, p, len);
+		text[len] = '\0';
+	}
+	else { /* COMPOUND_TEXT, or UTF8_STRING in a non UTF-8 locale */
+		name.value = p;
+		name.encoding = type;
+		name.format = format;
+		name.nitems = len;
+		if(XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && list) {
+			if(n > 0 && *list)
+				strncpy(text, *list, size - 1);
 			XFreeStringList(list);
 		}
 	}
 	text[size - 1] = '\0';
-	XFree(name.value);
+	XFree(p);
 	return True;
 }
 
+#ifdef SHM
+/* Returns the cached coverage of the character s[0..len).  New glyphs are
+ * drawn once server-side, white on black, into the unused bar pixmap and
+ * read back; the green channel is the coverage. */
+RasterGlyph *
+getglyph(const char *s, int len) {
+	unsigned int i, key = 0;
+	int x, y;
+	RasterGlyph *g;
+	XImage *img;
+
+	memcpy(&key, s, MIN(len, (int)sizeof key));
+	if(!key)
+		return NULL;
+	for(i = key * 2654435761U; (g = &raster.glyphs[i % GLYPHCACHE])->key; i++)
+		if(g->key == key)
+			return g;
+	if(raster.nglyphs >= GLYPHCACHE * 3 / 4) { /* keep the cache bounded */
+		flushglyphs();
+		return getglyph(s, len);
+	}
+	g->key = key;
+	g->w = textnw(s, len);
+	g->alpha = NULL;
+	raster.nglyphs++;
+	if(g->w <= 0) {
+		g->w = 0;
+		return g;
+	}
+	if(!(g->alpha = calloc(g->w * bh, 1)))
+		die("fatal: could not malloc() %u bytes\n", g->w * bh);
+	raster.on = False;
+	drawrect(0, 0, g->w, bh, True, BlackPixel(dpy, screen));
+	drawstring(0, (bh + dc.font.ascent - dc.font.descent) / 2, s, len, WhitePixel(dpy, screen));
+	raster.on = True;
+	if((img = XGetImage(dpy, dc.drawable, 0, 0, g->w, bh, AllPlanes, ZPixmap))) {
+		for(y = 0; y < bh; y++)
+			for(x = 0; x < g->w; x++)
+				g->alpha[y * g->w + x] = XGetPixel(img, x, y) >> raster.gshift;
+		XDestroyImage(img);
+	}
+	return g;
+}
+#endif /* SHM */
+
+Workspace *
+getws(unsigned int t) {
+	unsigned int n;
+
+	if(t >= mons->nws) {
+		for(n = mons->nws ? mons->nws : 16; n <= t; n *= 2);
+		if(!(mons->ws = realloc(mons->ws, n * sizeof *mons->ws)))
+			die("fatal: could not malloc() %u bytes\n", n * sizeof *mons->ws);
+		memset(mons->ws + mons->nws, 0, (n - mons->nws) * sizeof *mons->ws);
+		mons->nws = n;
+	}
+	if(!mons->ws[t]) {
+		if(!(mons->ws[t] = calloc(1, sizeof(Workspace))))
+			die("fatal: could not malloc() %u bytes\n", sizeof(Workspace));
+		/* from config.h */
+		mons->ws[t]->mfact = mfact;
+		mons->ws[t]->nmaster = nmaster;
+	}
+	return mons->ws[t];
+}
+
 void
 grabbuttons(Client *c, Bool focused) {
-	updatenumlockmask();
 	{
 		unsigned int i, j;
 		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
@@ -897,17 +2190,61 @@ grabkeys(void) {
 			             True, GrabModeAsync, GrabModeAsync);
 }
 
+Bool
+hastag(const TagSet *s, unsigned int t) {
+	if(t < TAGBITS)
+		return (s->w >> t) & 1;
+	t -= TAGBITS;
+	return t / TAGBITS < s->nmore && (s->more[t / TAGBITS] >> (t % TAGBITS)) & 1;
+}
+
+int
+hitcmp(const void *a, const void *b) {
+	const Hit *x = a, *y = b;
+
+	if(x->score != y->score)
+		return x->score - y->score;
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
 void
 incnmaster(const Arg *arg) {
-    mons->nmaster[mons->curtag] = MAX(mons->nmaster[mons->curtag] + arg->i, 0);
+    curws->nmaster = MAX(curws->nmaster + arg->i, 0);
 	arrange();
 }
 
+/* Notes which bytes c's name, class and instance have, so the switcher can
+ * pass over it without reading them when a typed one is missing. */
+void
+indexclient(Client *c) {
+	ClientInfo *ci = INFO(c);
+	const char *f[] = { ci->name, ci->class, ci->instance }, *p;
+	unsigned int i;
+
+	ci->letters = 0;
+	for(i = 0; i < LENGTH(f); i++)
+		for(p = f[i]; *p; p++)
+			ci->letters |= LETTER(*p);
+}
+
 void
 initfont(const char *fontstr) {
 	char *def, **missing;
 	int n;
 
+#ifdef XFT
+	if((dc.font.xft = XftFontOpenName(dpy, screen, xftfont))) {
+		dc.font.ascent = dc.font.xft->ascent;
+		dc.font.descent = dc.font.xft->descent;
+		dc.font.height = dc.font.ascent + dc.font.descent;
+		return;
+	}
+	fprintf(stderr, "ldwm: cannot load font '%s', using core fonts\n", xftfont);
+#endif /* XFT */
+	if(MB_CUR_MAX == 1) { /* a font set buys nothing, see finishfont() */
+		dc.font.fid = XLoadFont(dpy, fontstr);
+		return;
+	}
 	dc.font.set = XCreateFontSet(dpy, fontstr, &missing, &n, &def);
 	if(missing) {
         n=0;
@@ -936,6 +2273,497 @@ initfont(const char *fontstr) {
 	dc.font.height = dc.font.ascent + dc.font.descent;
 }
 
+#ifdef IPC
+/* Listens on $LDWM_SOCKET, by default ldwm-<display>.sock in
+ * $XDG_RUNTIME_DIR or /tmp, and exports the path to children. */
+void
+initipc(void) {
+	const char *path = getenv("LDWM_SOCKET"), *dir = getenv("XDG_RUNTIME_DIR");
+	struct stat st;
+	mode_t mask;
+	char *p;
+
+	ipcaddr.sun_family = AF_UNIX;
+	if(path)
+		snprintf(ipcaddr.sun_path, sizeof ipcaddr.sun_path, "%s", path);
+	else {
+		snprintf(ipcaddr.sun_path, sizeof ipcaddr.sun_path, "%s/ldwm-%s.sock",
+		         dir ? dir : "/tmp", DisplayString(dpy));
+		for(p = strrchr(ipcaddr.sun_path, '/') + 1; *p; p++)
+			if(*p == '/')
+				*p = '_';
+	}
+	/* a stale socket is replaced, anything else is left alone */
+	if(lstat(ipcaddr.sun_path, &st) == 0) {
+		if(!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "ldwm: ipc: %s is not a socket\n", ipcaddr.sun_path);
+			return;
+		}
+		unlink(ipcaddr.sun_path);
+	}
+	/* whoever can connect can drive the session, so only the user may */
+	mask = umask(077);
+	if((ipcfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	|| bind(ipcfd, (struct sockaddr *)&ipcaddr, sizeof ipcaddr) < 0
+	|| listen(ipcfd, IPCCONNS) < 0
+	|| (ipcreqfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+	|| (ipcrepfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		perror("ldwm: ipc");
+		umask(mask);
+		if(ipcfd >= 0)
+			close(ipcfd);
+		ipcfd = -1;
+		return;
+	}
+	umask(mask);
+	fcntl(ipcfd, F_SETFD, FD_CLOEXEC);
+	fcntl(ipcfd, F_SETFL, O_NONBLOCK);
+	if((errno = pthread_create(&ipcthr, NULL, ipcthread, NULL))) {
+		perror("ldwm: ipc thread");
+		close(ipcfd);
+		ipcfd = -1;
+		return;
+	}
+	setenv("LDWM_SOCKET", ipcaddr.sun_path, 1);
+}
+#endif /* IPC */
+
+#ifdef SHM
+void
+initraster(void) {
+	Visual *v = DefaultVisual(dpy, screen);
+	int depth = DefaultDepth(dpy, screen);
+	unsigned int one = 1;
+	char *data;
+
+	if(v->class != TrueColor || (depth != 24 && depth != 32)
+	|| (raster.rshift = maskshift(v->red_mask)) < 0
+	|| (raster.gshift = maskshift(v->green_mask)) < 0
+	|| (raster.bshift = maskshift(v->blue_mask)) < 0)
+		return;
+	if(XShmQueryExtension(dpy)
+	&& (raster.img = XShmCreateImage(dpy, v, depth, ZPixmap, NULL, &raster.info, mons->ww, bh))) {
+		raster.info.shmid = shmget(IPC_PRIVATE, raster.img->bytes_per_line * raster.img->height,
+		                           IPC_CREAT|0600);
+		raster.info.shmaddr = raster.info.shmid == -1 ? (char *)-1 : shmat(raster.info.shmid, NULL, 0);
+		if(raster.info.shmaddr != (char *)-1) {
+			raster.img->data = raster.info.shmaddr;
+			raster.info.readOnly = False;
+			/* attaching fails on remote displays */
+			shmerror = False;
+			XSetErrorHandler(xerrorshm);
+			XShmAttach(dpy, &raster.info);
+			XSync(dpy, False);
+			XSetErrorHandler(xerror);
+			if(!(raster.shm = !shmerror))
+				shmdt(raster.info.shmaddr);
+		}
+		if(raster.info.shmid != -1)
+			shmctl(raster.info.shmid, IPC_RMID, NULL);
+		if(!raster.shm) {
+			raster.img->data = NULL;
+			XDestroyImage(raster.img);
+			raster.img = NULL;
+		}
+	}
+	if(raster.shm)
+		raster.event = XShmGetEventBase(dpy) + ShmCompletion;
+	else if(!(data = malloc(mons->ww * bh * 4))
+	|| !(raster.img = XCreateImage(dpy, v, depth, ZPixmap, 0, data, mons->ww, bh, 32, 0))) {
+		free(data);
+		return;
+	}
+	if(raster.img->bits_per_pixel != 32
+	|| raster.img->byte_order != (*(char *)&one ? LSBFirst : MSBFirst)) {
+		freeraster();
+		return;
+	}
+	if(!(raster.prev = calloc(mons->ww * bh, sizeof *raster.prev))
+	|| !(raster.cols = malloc(mons->ww)))
+		die("fatal: could not malloc() %u bytes\n", mons->ww * bh * sizeof *raster.prev);
+	raster.full = True;
+	raster.on = True;
+}
+#endif /* SHM */
+
+/* Checks the words beyond the inline one; ISVISIBLE tests that first. */
+Bool
+intersects(const TagSet *a, const TagSet *b) {
+	unsigned int i;
+
+	for(i = 0; i < a->nmore && i < b->nmore; i++)
+		if(a->more[i] & b->more[i])
+			return True;
+	return False;
+}
+
+#ifdef IPC
+/* Closes connection c, letting go of the events it still had queued. */
+void
+ipcclose(IpcConn *c) {
+	close(c->fd);
+	c->fd = -1;
+	free(c->out);
+	c->out = NULL;
+	for(; c->evlen; c->evlen--, c->evhead++)
+		ipcrelease(c->evq[c->evhead % IPCQUEUE]);
+	c->drops = 0;
+	if(c->subscribed)
+		__atomic_sub_fetch(&ipcsubs, 1, __ATOMIC_RELAXED);
+	c->subscribed = False;
+}
+
+/* Moves the events queued for subscriber c to its output once everything
+ * else it was sent has gone out, followed by a note on those it missed. */
+void
+ipcdeliver(IpcConn *c) {
+	IpcEvent *ev;
+	char note[64];
+	size_t len = 0;
+	int notelen = 0;
+	unsigned int i;
+
+	if(c->pending || c->outoff < c->outlen || (!c->evlen && !c->drops))
+		return;
+	for(i = 0; i < c->evlen; i++)
+		len += c->evq[(c->evhead + i) % IPCQUEUE]->len;
+	if(c->drops)
+		notelen = snprintf(note, sizeof note, "{\"event\":\"dropped\",\"count\":%lu}\n", c->drops);
+	free(c->out);
+	if(!(c->out = malloc(len + notelen))) { /* the subscriber hears of them as dropped */
+		for(; c->evlen; c->evlen--, c->evhead++, c->drops++)
+			ipcrelease(c->evq[c->evhead % IPCQUEUE]);
+		return;
+	}
+	for(; c->evlen; c->evlen--, c->evhead++) {
+		ev = c->evq[c->evhead % IPCQUEUE];
+		memcpy(c->out + c->outlen, ev->text, ev->len);
+		c->outlen += ev->len;
+		ipcrelease(ev);
+	}
+	memcpy(c->out + c->outlen, note, notelen);
+	c->outlen += notelen;
+	c->drops = 0;
+}
+
+/* Runs the requests ipcthread() queued and hands back one line of JSON for
+ * each, in order. Executed by the X thread only. */
+void
+ipcdispatch(void) {
+	IpcRequest *req;
+	IpcReply *rep;
+	uint64_t n;
+	FILE *f;
+
+	if(read(ipcreqfd, &n, sizeof n) != sizeof n)
+		return;
+	for(n = 0; (req = ringget(&ipcreqs)); n++) {
+		if(!(rep = calloc(1, sizeof *rep)))
+			die("fatal: could not malloc() %u bytes\n", sizeof *rep);
+		rep->conn = req->conn;
+		rep->gen = req->gen;
+		if(!(f = open_memstream(&rep->text, &rep->len)))
+			die("fatal: could not open memory stream\n");
+		if(req->error)
+			fprintf(f, "{\"ok\":false,\"error\":\"%s\"}", req->error);
+		else if(req->query)
+			req->query(f, &req->arg);
+		else {
+			req->cmd->func(&req->arg);
+			fputs("{\"ok\":true}", f);
+		}
+		fputc('\n', f);
+		fclose(f);
+		ringput(&ipcreplies, rep); /* ipcthread() keeps at most IPCRING in flight */
+		free(req);
+	}
+	if(n && write(ipcrepfd, &n, sizeof n) != sizeof n)
+		perror("ldwm: ipc");
+}
+
+/* Hands the events notify() queued to every subscriber with room left for
+ * them; the others only count what they miss. */
+void
+ipcfanout(IpcConn *conns) {
+	IpcEvent *ev;
+	IpcConn *c;
+
+	while((ev = ringget(&ipcevents))) {
+		ev->refs = 1;
+		for(c = conns; c < conns + IPCCONNS; c++) {
+			if(c->fd < 0 || !c->subscribed)
+				continue;
+			c->drops += ev->lost;
+			if(c->evlen == IPCQUEUE)
+				c->drops++;
+			else {
+				c->evq[(c->evhead + c->evlen++) % IPCQUEUE] = ev;
+				ev->refs++;
+			}
+		}
+		ipcrelease(ev);
+	}
+}
+
+/* Queues the complete lines read on connection c as requests. */
+void
+ipclines(IpcConn *c, unsigned int i, unsigned int *inflight) {
+	IpcRequest *req;
+	unsigned int j;
+	char *nl, *name, *arg, *end, *save;
+	size_t len;
+
+	if(c->discard) { /* only its error gets an answer */
+		if(!(nl = memchr(c->in, '\n', c->inlen))) {
+			c->inlen = 0;
+			return;
+		}
+		len = nl - c->in + 1;
+		memmove(c->in, c->in + len, c->inlen - len);
+		c->inlen -= len;
+		c->discard = False;
+	}
+	while(*inflight < IPCRING && (nl = memchr(c->in, '\n', c->inlen))) {
+		*nl = '\0';
+		len = nl - c->in + 1;
+		if(!(req = calloc(1, sizeof *req)))
+			break;
+		req->conn = i;
+		req->gen = c->gen;
+		name = strtok_r(c->in, " \t\r", &save);
+		arg = strtok_r(NULL, " \t\r", &save);
+		if(!name)
+			req->error = "empty line";
+		else {
+			for(j = 0; j < LENGTH(commands) && strcmp(name, commands[j].name); j++);
+			if(j < LENGTH(commands)) {
+				req->cmd = &commands[j];
+				if(req->cmd->argtype != CmdNone && !arg)
+					req->error = "missing argument";
+				else if(req->cmd->argtype == CmdInt)
+					req->arg.i = strtol(arg, &end, 10);
+				else if(req->cmd->argtype == CmdFloat)
+					req->arg.f = strtof(arg, &end);
+				if(!req->error && req->cmd->argtype != CmdNone && *end)
+					req->error = "bad argument";
+			}
+			else {
+				for(j = 0; j < LENGTH(queries) && strcmp(name, queries[j].name); j++);
+				if(j < LENGTH(queries)) {
+					req->query = queries[j].query;
+					req->arg.i = arg ? atoi(arg) : 0;
+					if(req->query == querysubscribe && !c->subscribed) {
+						c->subscribed = True;
+						__atomic_add_fetch(&ipcsubs, 1, __ATOMIC_RELAXED);
+					}
+				}
+				else
+					req->error = "unknown command";
+			}
+		}
+		memmove(c->in, c->in + len, c->inlen - len);
+		c->inlen -= len;
+		ringput(&ipcreqs, req);
+		(*inflight)++;
+		c->pending++;
+	}
+	if(c->inlen == sizeof c->in && *inflight < IPCRING && (req = calloc(1, sizeof *req))) {
+		req->conn = i; /* no room left for the line end */
+		req->gen = c->gen;
+		req->error = "line too long";
+		c->inlen = 0;
+		c->discard = True;
+		ringput(&ipcreqs, req);
+		(*inflight)++;
+		c->pending++;
+	}
+}
+
+void
+ipcrelease(IpcEvent *ev) {
+	if(--ev->refs)
+		return;
+	free(ev->text);
+	free(ev);
+}
+
+/* The socket side of the IPC server: accepts connections, splits what they
+ * send into requests for run() and writes back its replies. Never touches
+ * any state of the X thread. */
+void *
+ipcthread(void *unused) {
+	static IpcConn conns[IPCCONNS];
+	struct pollfd pfd[IPCCONNS + 2];
+	unsigned int i, inflight = 0, queued;
+	IpcConn *c;
+	IpcReply *rep;
+	uint64_t n;
+	ssize_t len;
+	char *buf;
+	int fd;
+
+	for(i = 0; i < IPCCONNS; i++)
+		conns[i].fd = -1;
+	while(!__atomic_load_n(&ipcstop, __ATOMIC_ACQUIRE)) {
+		pfd[0].fd = ipcfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = ipcrepfd;
+		pfd[1].events = POLLIN;
+		for(i = 0; i < IPCCONNS; i++) {
+			pfd[i + 2].fd = conns[i].hup ? -1 : conns[i].fd;
+			pfd[i + 2].events = (inflight < IPCRING && !conns[i].eof ? POLLIN : 0)
+			                  | (conns[i].outoff < conns[i].outlen ? POLLOUT : 0);
+			pfd[i + 2].revents = 0;
+		}
+		if(poll(pfd, IPCCONNS + 2, -1) < 0) {
+			if(errno == EINTR)
+				continue;
+			perror("ldwm: ipc poll");
+			break;
+		}
+		if(pfd[1].revents & POLLIN && read(ipcrepfd, &n, sizeof n) == sizeof n) {
+			while((rep = ringget(&ipcreplies))) {
+				inflight--;
+				c = &conns[rep->conn];
+				if(c->fd >= 0 && c->gen == rep->gen && !c->hup) { /* else nobody reads it */
+					c->pending--;
+					/* the X thread must not be taken down from here; a
+					 * reply that does not fit ends the connection */
+					if(!(buf = realloc(c->out, c->outlen + rep->len)))
+						ipcclose(c);
+					else {
+						memcpy(buf + c->outlen, rep->text, rep->len);
+						c->out = buf;
+						c->outlen += rep->len;
+					}
+				}
+				free(rep->text);
+				free(rep);
+			}
+			ipcfanout(conns);
+		}
+		queued = inflight;
+		if(pfd[0].revents & POLLIN && (fd = accept(ipcfd, NULL, NULL)) >= 0) {
+			for(i = 0; i < IPCCONNS && conns[i].fd >= 0; i++);
+			if(i == IPCCONNS)
+				close(fd);
+			else {
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				conns[i].fd = fd;
+				conns[i].gen++;
+				conns[i].inlen = conns[i].outlen = conns[i].outoff = 0;
+				conns[i].pending = 0;
+				conns[i].eof = conns[i].hup = conns[i].discard = False;
+			}
+		}
+		for(i = 0; i < IPCCONNS; i++) {
+			c = &conns[i];
+			if(c->fd < 0)
+				continue;
+			if(pfd[i + 2].revents & POLLOUT) {
+				/* a peer gone away must not raise SIGPIPE */
+				len = send(c->fd, c->out + c->outoff, c->outlen - c->outoff, MSG_NOSIGNAL);
+				if(len > 0 && (c->outoff += len) == c->outlen)
+					c->outoff = c->outlen = 0;
+				else if(len < 0 && errno != EAGAIN && errno != EINTR)
+					pfd[i + 2].revents |= POLLERR;
+			}
+			if(pfd[i + 2].revents & (POLLERR | POLLHUP)) { /* nobody left to answer */
+				c->hup = True;
+				c->outlen = c->outoff = 0;
+			}
+			if(c->hup) {
+				/* poll() would report the hangup for good, so what the
+				 * peer wrote before it is read without */
+				ipclines(c, i, &inflight);
+				while(!c->eof && c->inlen < sizeof c->in && inflight < IPCRING) {
+					if((len = read(c->fd, c->in + c->inlen, sizeof c->in - c->inlen)) <= 0)
+						c->eof = True;
+					else
+						c->inlen += len;
+					ipclines(c, i, &inflight);
+				}
+				if(c->eof && !memchr(c->in, '\n', c->inlen))
+					ipcclose(c);
+				continue;
+			}
+			if(pfd[i + 2].revents & POLLIN && !c->eof && c->inlen < sizeof c->in) {
+				len = read(c->fd, c->in + c->inlen, sizeof c->in - c->inlen);
+				if(len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))
+					c->eof = True; /* replies still go out */
+				else if(len > 0)
+					c->inlen += len;
+			}
+			ipclines(c, i, &inflight); /* also picks up lines held back earlier */
+			ipcdeliver(c);
+			/* subscribers stay until they hang up */
+			if(c->eof && !c->subscribed && !c->pending && c->outoff == c->outlen
+			&& !memchr(c->in, '\n', c->inlen))
+				ipcclose(c);
+		}
+		n = 1;
+		if(inflight > queued && write(ipcreqfd, &n, sizeof n) != sizeof n)
+			perror("ldwm: ipc");
+	}
+	for(i = 0; i < IPCCONNS; i++)
+		if(conns[i].fd >= 0)
+			ipcclose(&conns[i]);
+	return NULL;
+}
+#endif /* IPC */
+
+Bool
+isstacked(Client *c) {
+	Client *t;
+
+	for(t = mons->stack; t && t != c; t = t->snext);
+	return t != NULL;
+}
+
+#ifdef IPC
+/* Writes the fields describing c, without the braces around them. */
+void
+jsonclient(FILE *f, Client *c) {
+	int t;
+
+	refreshtitle(c);
+	fprintf(f, "\"window\":%lu,\"class\":", c->win);
+	jsonstr(f, INFO(c)->class);
+	fputs(",\"instance\":", f);
+	jsonstr(f, INFO(c)->instance);
+	fputs(",\"title\":", f);
+	jsonstr(f, INFO(c)->name);
+	fputs(",\"tags\":[", f);
+	for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1))
+		fprintf(f, "%s%d", t == nexttag(&c->tags, 0) ? "" : ",", t);
+	fputc(']', f);
+}
+
+void
+jsonstr(FILE *f, const char *s) {
+	fputc('"', f);
+	for(; *s; s++)
+		if(*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	fputc('"', f);
+}
+
+void
+jsonview(FILE *f) {
+	int t;
+
+	fprintf(f, "\"tag\":%u,\"view\":[", mons->curtag);
+	for(t = nexttag(&mons->view, 0); t != -1; t = nexttag(&mons->view, t + 1))
+		fprintf(f, "%s%d", t == nexttag(&mons->view, 0) ? "" : ",", t);
+	fputc(']', f);
+}
+#endif /* IPC */
+
 void
 keypress(XEvent *e) {
 	unsigned int i;
@@ -943,19 +2771,30 @@ keypress(XEvent *e) {
 	XKeyEvent *ev;
 
 	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-	for(i = 0; i < LENGTH(keys); i++)
-		if(keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-		&& keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	if(switching)
+		switcherkey(ev);
+	else {
+		keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
+		for(i = 0; i < LENGTH(keys); i++)
+			if(keysym == keys[i].keysym
+			&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
+			&& keys[i].func)
+				keys[i].func(&(keys[i].arg));
+	}
+	if(bardirty) /* user input is not paced */
+		drawbar();
 }
 
 void
 killclient(const Arg *arg) {
-	if(!mons->sel)
+	if(!mons->sel || (mons->sel->ishung && killhung(mons->sel)))
 		return;
-	if(!sendevent(mons->sel, wmatom[WMDelete])) {
+	/* a hung client would not act on WM_DELETE_WINDOW either */
+	if(!mons->sel->ishung && sendevent(mons->sel, wmatom[WMDelete])) {
+		if(mons->sel->canping && !mons->sel->pingwait)
+			ping(mons->sel); /* so that a second try knows if it hangs */
+	}
+	else {
 		XGrabServer(dpy);
 		XSetErrorHandler(xerrordummy);
 		XSetCloseDownMode(dpy, DestroyAll);
@@ -966,17 +2805,48 @@ killclient(const Arg *arg) {
 	}
 }
 
+pid_t
+launch(const char **cmd) {
+	pid_t pid;
+
+	if((pid = fork()) == 0) {
+		if(dpy)
+			close(ConnectionNumber(dpy));
+		setsid();
+		execvp(cmd[0], (char **)cmd);
+		fprintf(stderr, "ldwm: execvp %s", cmd[0]);
+		perror(" failed");
+		exit(EXIT_SUCCESS);
+	}
+	return pid;
+}
+
+/* Kills the process behind hung client c, if it runs on this host, rather
+ * than grabbing the server for XKillClient(). Returns False if it could
+ * not, e.g. for a remote client. */
+Bool
+killhung(Client *c) {
+	char host[256], machine[256];
+	long pid;
+
+	if(!gettextprop(c->win, XA_WM_CLIENT_MACHINE, machine, sizeof machine)
+	|| gethostname(host, sizeof host) < 0 || strncmp(host, machine, sizeof host))
+		return False;
+	return (pid = winpid(c->win)) > 0 && kill(pid, SIGKILL) == 0; /* its windows go with its connection */
+}
+
 void
 manage(Window w, XWindowAttributes *wa) {
 	Client *c = NULL;
 	Window trans = None;
 	XWindowChanges wc;
+	Bool pooled;
 
-	if(!(c = calloc(1, sizeof(Client))))
-		die("fatal: could not malloc() %u bytes\n", sizeof(Client));
+	c = allocclient();
 	c->win = w;
 	updatetitle(c);
 	applyrules(c);
+	pooled = poolclient(c);
 
 	/* geometry */
 	c->x = c->oldx = wa->x;
@@ -1002,20 +2872,32 @@ manage(Window w, XWindowAttributes *wa) {
 	updatewindowtype(c);
 	updatesizehints(c);
 	updatewmhints(c);
+	updateprotocols(c);
+#ifdef XSYNC
+	updatesync(c);
+#endif /* XSYNC */
 	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, False);
 	if(!c->isfloating)
 		c->isfloating = c->oldstate = trans != None || c->isfixed;
+	/* unless it asked for a spot on purpose */
+	if((c->isfloating || curlayout.arrange == floating) && !(INFO(c)->hints & USPosition)
+	&& !((INFO(c)->hints & PPosition) && (wa->x || wa->y)))
+		place(c);
 	if(c->isfloating)
 		XRaiseWindow(dpy, c->win);
 	attach(c);
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-	                (unsigned char *) &(c->win), 1);
+	notify("manage", c);
+	if(!pooled) /* unpool() lists it */
+		XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
+		                (unsigned char *) &(c->win), 1);
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
 	setclientstate(c, NormalState);
-    unfocus(mons->sel, False);
-	mons->sel = c;
+	if(!pooled) {
+		unfocus(mons->sel, False);
+		mons->sel = c;
+	}
 	arrange();
 	XMapWindow(dpy, c->win);
 	focus(NULL);
@@ -1024,10 +2906,14 @@ manage(Window w, XWindowAttributes *wa) {
 void
 mappingnotify(XEvent *e) {
 	XMappingEvent *ev = &e->xmapping;
+	Client *c;
 
 	XRefreshKeyboardMapping(ev);
-	if(ev->request == MappingKeyboard)
-		grabkeys();
+	if(ev->request == MappingKeyboard || ev->request == MappingModifier) {
+		grabkeys(); /* rereads numlockmask */
+		for(c = mons->clients; c; c = c->next)
+			grabbuttons(c, c == mons->sel);
+	}
 }
 
 void
@@ -1043,6 +2929,29 @@ maprequest(XEvent *e) {
 		manage(ev->window, &wa);
 }
 
+#ifdef XFT
+/* extracts the color component selected by mask from a TrueColor pixel,
+ * scaled to 16 bits */
+unsigned short
+maskcomp(unsigned long pixel, unsigned long mask) {
+	if(!mask)
+		return 0;
+	for(; !(mask & 1); mask >>= 1, pixel >>= 1);
+	return (unsigned short)(((pixel & mask) * 0xffff) / mask);
+}
+#endif /* XFT */
+
+#ifdef SHM
+/* returns the shift of an 8 bit color mask, -1 for other masks */
+int
+maskshift(unsigned long mask) {
+	int shift;
+
+	for(shift = 0; mask && !(mask & 1); mask >>= 1, shift++);
+	return mask == 0xff ? shift : -1;
+}
+#endif /* SHM */
+
 void
 monocle(void) {
 	unsigned int n = 0;
@@ -1058,9 +2967,13 @@ monocle(void) {
 
 void
 movemouse(const Arg *arg) {
-	int x, y, ocx, ocy, nx, ny;
+	int x, y, ocx, ocy, nx, ny, nw, nh, fx = 0, fy = 0, fw = 0, fh = 0;
+	Bool shown = False;
 	Client *c;
 	XEvent ev;
+#ifdef XSYNC
+	XEvent sev;
+#endif /* XSYNC */
 
 	if(!(c = mons->sel))
 		return;
@@ -1086,6 +2999,11 @@ movemouse(const Arg *arg) {
 			handler[ev.type](&ev);
 			break;
 		case MotionNotify:
+#ifdef XSYNC
+			while(XCheckTypedEvent(dpy, syncevent, &sev))
+				syncalarm(&sev);
+			synctimeouts();
+#endif /* XSYNC */
 			nx = ocx + (ev.xmotion.x - x);
 			ny = ocy + (ev.xmotion.y - y);
 			if(nx >= mons->wx && nx <= mons->wx + mons->ww
@@ -1094,19 +3012,45 @@ movemouse(const Arg *arg) {
 					nx = mons->wx;
 				else if(abs((mons->wx + mons->ww) - (nx + WIDTH(c))) < snap)
 					nx = mons->wx + mons->ww - WIDTH(c);
+				else
+					nx += snapedge(c, nx, ny, False);
 				if(abs(mons->wy - ny) < snap)
 					ny = mons->wy;
 				else if(abs((mons->wy + mons->wh) - (ny + HEIGHT(c))) < snap)
 					ny = mons->wy + mons->wh - HEIGHT(c);
+				else
+					ny += snapedge(c, nx, ny, True);
 				if(!c->isfloating && curlayout.arrange != floating
-                &&(abs(nx - c->x) > snap || abs(ny - c->y) > snap))
+                &&(abs(nx - c->x) > snap || abs(ny - c->y) > snap)) {
+					if(shown)
+						drawoutline(c, fx, fy, fw, fh);
+					shown = False;
 					togglefloating(NULL);
+				}
 			}
-			if(c->isfloating || curlayout.arrange == floating)
+			if(!(c->isfloating || curlayout.arrange == floating))
+				break;
+			if(!outline) {
 				resize(c, nx, ny, c->w, c->h, True);
+				break;
+			}
+			nw = c->w;
+			nh = c->h;
+			applysizehints(c, &nx, &ny, &nw, &nh, True);
+			if(shown)
+				drawoutline(c, fx, fy, fw, fh);
+			else
+				XGrabServer(dpy); /* nothing may paint over the outline */
+			drawoutline(c, fx = nx, fy = ny, fw = nw, fh = nh);
+			shown = True;
 			break;
 		}
 	} while(ev.type != ButtonRelease);
+	if(shown) {
+		drawoutline(c, fx, fy, fw, fh);
+		XUngrabServer(dpy);
+		resize(c, fx, fy, fw, fh, True);
+	}
 	XUngrabPointer(dpy, CurrentTime);
 }
 
@@ -1116,6 +3060,228 @@ nexttiled(Client *c) {
 	return c;
 }
 
+/* Returns the lowest tag in s from t on, or -1. */
+int
+nexttag(const TagSet *s, unsigned int t) {
+	unsigned long word;
+	unsigned int i;
+
+	for(i = t / TAGBITS; i <= s->nmore; i++, t = i * TAGBITS) {
+		word = (i ? s->more[i - 1] : s->w) >> (t % TAGBITS);
+		if(word)
+			return t + __builtin_ctzl(word);
+	}
+	return -1;
+}
+
+/* Tells subscribers on the socket what just changed. Events about a client
+ * describe it, the others the viewed tags. */
+void
+notify(const char *event, Client *c) {
+#ifdef IPC
+	IpcEvent *ev;
+	FILE *f;
+
+	if(ipcfd < 0 || !__atomic_load_n(&ipcsubs, __ATOMIC_RELAXED) || (c && c->ispooled))
+		return;
+	if(!(ev = calloc(1, sizeof *ev)))
+		die("fatal: could not malloc() %u bytes\n", sizeof *ev);
+	if(!(f = open_memstream(&ev->text, &ev->len)))
+		die("fatal: could not open memory stream\n");
+	fprintf(f, "{\"event\":\"%s\",", event);
+	if(c)
+		jsonclient(f, c);
+	else
+		jsonview(f);
+	fputs("}\n", f);
+	fclose(f);
+	ev->lost = ipclost;
+	if(!ringput(&ipcevents, ev)) { /* ipcthread() is behind; never wait for it */
+		ipclost++;
+		free(ev->text);
+		free(ev);
+		return;
+	}
+	ipclost = 0;
+	ipcunsent++;
+#endif /* IPC */
+}
+
+long
+now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+Bool
+occupied(unsigned int t) {
+	return t < mons->nws && mons->ws[t] && mons->ws[t]->nclients;
+}
+
+Bool
+onlytag(const TagSet *s, unsigned int t) {
+	return hastag(s, t) && nexttag(s, 0) == t && nexttag(s, t + 1) == -1;
+}
+
+/* Returns the area of x, y, w, h covered by the windows filed in ws. */
+long
+overlaparea(Workspace *ws, Client *c, int x, int y, int w, int h) {
+	ClientInfo *oi;
+	Edge *e = ws->xedges;
+	unsigned int i;
+	long area = 0;
+	int dx, dy;
+
+	for(i = 0; i < ws->nedges && e[i].pos < x + w; i++) {
+		oi = INFO(e[i].c);
+		if(e[i].c == c || e[i].pos != oi->ix) /* left sides only */
+			continue;
+		dx = MIN(x + w, oi->ix + oi->iw) - MAX(x, oi->ix);
+		dy = MIN(y + h, oi->iy + oi->ih) - MAX(y, oi->iy);
+		if(dx > 0 && dy > 0)
+			area += (long)dx * dy;
+	}
+	return area;
+}
+
+void
+ping(Client *c) {
+	XEvent ev;
+	ClientInfo *ci = INFO(c);
+
+	ev.type = ClientMessage;
+	ev.xclient.window = c->win;
+	ev.xclient.message_type = wmatom[WMProtocols];
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = netatom[NetWMPing];
+	ev.xclient.data.l[1] = CurrentTime;
+	ev.xclient.data.l[2] = c->win;
+	ev.xclient.data.l[3] = ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+	c->pingwait = True;
+	ci->pingsent = now();
+	if(nextping < 0 || ci->pingsent + pingtimeout < nextping)
+		nextping = ci->pingsent + pingtimeout;
+}
+
+/* Pings every client that can answer once per pinginterval and marks those
+ * that leave it unanswered for pingtimeout as hung, until they answer after
+ * all. Returns the ms until there is more to do, or -1 if nothing is due. */
+long
+pingclients(void) {
+	long t = now(), due, next = pinginterval ? t + pinginterval : -1;
+	Client *c;
+
+	if(nextping < 0 || t < nextping)
+		return nextping < 0 ? -1 : nextping - t;
+	for(c = mons->clients; c; c = c->next) {
+		if(!c->canping)
+			continue;
+		if(c->pingwait) {
+			if((due = INFO(c)->pingsent + pingtimeout) <= t) {
+				if(!c->ishung) {
+					c->ishung = True;
+					if(c == mons->sel)
+						requestbar();
+				}
+				continue;
+			}
+		}
+		else if(!pinginterval)
+			continue;
+		else if((due = INFO(c)->pingsent + pinginterval) <= t) {
+			ping(c);
+			due = t + pingtimeout;
+		}
+		if(next < 0 || due < next)
+			next = due;
+	}
+	nextping = next;
+	return next < 0 ? -1 : next - t;
+}
+
+/* Moves new floating client c to where it covers the least of the other
+ * windows on its tag. Tried are the work area's top left corner and the
+ * spots next to the sides of those windows, top left first, so the first
+ * free one wins. On crowded tags only every so many of them are tried. */
+void
+place(Client *c) {
+	Workspace *ws;
+	Edge *e;
+	int w = WIDTH(c), h = HEIGHT(c), t = nexttag(&c->tags, 0), *pos[2], bx = c->x, by = c->y, x, y;
+	unsigned int a, i, j, n[2];
+	long area, best = -1;
+
+	if(t == -1 || !(ws = getws(t))->nedges || w > mons->ww || h > mons->wh)
+		return;
+	for(a = 0; a < 2; a++) {
+		if(!(pos[a] = malloc((2 * ws->nedges + 1) * sizeof(int))))
+			die("fatal: could not malloc() %u bytes\n", (2 * ws->nedges + 1) * sizeof(int));
+		e = a ? ws->yedges : ws->xedges;
+		pos[a][0] = a ? mons->wy : mons->wx;
+		/* both lists come sorted, merge them */
+		for(n[a] = 1, i = j = 0; i < ws->nedges || j < ws->nedges; ) {
+			if(j == ws->nedges || (i < ws->nedges && e[i].pos <= e[j].pos - (a ? h : w)))
+				x = e[i++].pos;
+			else
+				x = e[j++].pos - (a ? h : w);
+			if(x != pos[a][n[a] - 1])
+				pos[a][n[a]++] = x;
+		}
+	}
+	for(i = 0; i < n[1] && best; i += 1 + n[1] / PLACESTEPS) {
+		if((y = pos[1][i]) < mons->wy || y + h > mons->wy + mons->wh)
+			continue;
+		for(j = 0; j < n[0] && best; j += 1 + n[0] / PLACESTEPS) {
+			if((x = pos[0][j]) < mons->wx || x + w > mons->wx + mons->ww)
+				continue;
+			area = overlaparea(ws, c, x, y, w, h);
+			if(best < 0 || area < best) {
+				best = area;
+				bx = x;
+				by = y;
+			}
+		}
+	}
+	free(pos[0]);
+	free(pos[1]);
+	c->x = bx;
+	c->y = by;
+}
+
+/* Takes c into the pool whose launch it answers, leaving it untagged and
+ * thus hidden. Windows are told apart by the pid of the launch, so one
+ * the user started meanwhile is left alone. */
+Bool
+poolclient(Client *c) {
+	unsigned int i, j = 0;
+	long pid;
+
+	if(!(pid = winpid(c->win)))
+		return False;
+	for(i = 0; i < LENGTH(pools); i++)
+		if(!strcmp(INFO(c)->class, pools[i].class)) {
+			for(j = 0; j < poolpending[i] && poolpids[i][j] != pid; j++);
+			if(j < poolpending[i])
+				break;
+		}
+	if(i == LENGTH(pools))
+		return False;
+	poolpids[i][j] = poolpids[i][--poolpending[i]];
+	if(poolwant[i]) {
+		poolwant[i]--;
+		return False;
+	}
+	free(c->tags.more);
+	memset(&c->tags, 0, sizeof c->tags);
+	c->ispooled = True;
+	INFO(c)->pool = i;
+	poolready[i]++;
+	return True;
+}
+
 void
 pop(Client *c) {
 	detach(c);
@@ -1132,9 +3298,11 @@ propertynotify(XEvent *e) {
 
 	if((ev->window == root) && (ev->atom == XA_WM_NAME))
         updatestatus();
-	else if(ev->state == PropertyDelete)
-		return; /* ignore */
 	else if((c = wintoclient(ev->window))) {
+		culprit = c;
+		countprop(c, ev->atom);
+		if(ev->state == PropertyDelete)
+			return; /* ignore */
 		switch(ev->atom) {
 		default: break;
 		case XA_WM_TRANSIENT_FOR:
@@ -1147,22 +3315,214 @@ propertynotify(XEvent *e) {
 			break;
 		case XA_WM_HINTS:
 			updatewmhints(c);
-            drawbar();
+			requestbar();
 			break;
 		}
 		if(ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-			updatetitle(c);
-			if(c == mons->sel)
-				drawbar();
+			/* only read back once the title is actually needed, which
+			 * the switcher's matching and drawing do right away */
+			c->titlestale = True;
+			if(switching)
+				refreshtitle(c);
+			if(c == mons->sel || switching)
+				requestbar();
+			notify("title", c);
 		}
 		if(ev->atom == netatom[NetWMWindowType])
 			updatewindowtype(c);
+		if(ev->atom == wmatom[WMProtocols])
+			updateprotocols(c);
+#ifdef XSYNC
+		if(ev->atom == wmatom[WMProtocols] || ev->atom == netatom[NetWMSyncRequestCounter])
+			updatesync(c);
+#endif /* XSYNC */
 	}
 }
 
+/* Forgets the pool launches that exited without mapping a window, e.g. for
+ * want of the program, so that spawn() starts new ones. */
+void
+prunepools(void) {
+	unsigned int i, j;
+
+	reaped = False;
+	for(i = 0; i < LENGTH(pools); i++) {
+		for(j = 0; j < poolpending[i]; )
+			if(kill(poolpids[i][j], 0) == -1)
+				poolpids[i][j] = poolpids[i][--poolpending[i]];
+			else
+				j++;
+		poolwant[i] = MIN(poolwant[i], poolpending[i]);
+	}
+}
+
+#ifdef IPC
+/* What a long running instance holds on to, for spotting leaks. */
+void
+queryresources(FILE *f, const Arg *arg) {
+	FILE *statm;
+	long pages = 0;
+	unsigned int n, ws, t;
+	Client *c;
+
+	if((statm = fopen("/proc/self/statm", "r"))) {
+		if(fscanf(statm, "%*s %ld", &pages) != 1)
+			pages = 0;
+		fclose(statm);
+	}
+	for(n = 0, c = mons->clients; c; c = c->next)
+		n += !c->ispooled; /* those are held on purpose */
+	for(ws = t = 0; t < mons->nws; t++)
+		ws += mons->ws[t] != NULL;
+	fprintf(f, "{\"rss\":%ld,\"clients\":%u,\"slots\":%u,\"workspaces\":%u,"
+	        "\"regions\":%u,\"subscribers\":%d", pages * (sysconf(_SC_PAGESIZE) / 1024),
+	        n, nslabs * POOLCHUNK, ws, regionsz, __atomic_load_n(&ipcsubs, __ATOMIC_RELAXED));
+#ifdef SHM
+	fprintf(f, ",\"glyphs\":%u", raster.nglyphs);
+#endif /* SHM */
+	fputc('}', f);
+}
+
+void
+querystate(FILE *f, const Arg *arg) {
+	Client *c;
+	Bool first = True;
+
+	fputc('{', f);
+	jsonview(f);
+	fputs(",\"layout\":", f);
+	jsonstr(f, curlayout.symbol);
+	fprintf(f, ",\"mfact\":%.2f,\"nmaster\":%d,\"focused\":%lu,\"clients\":[",
+	        curws->mfact, curws->nmaster, mons->sel ? mons->sel->win : 0);
+	for(c = mons->clients; c; c = c->next) {
+		if(c->ispooled)
+			continue;
+		fputs(first ? "{" : ",{", f);
+		first = False;
+		jsonclient(f, c);
+		fprintf(f, ",\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"floating\":%s,\"fullscreen\":%s,\"hung\":%s}",
+		        c->x, c->y, c->w, c->h, c->isfloating ? "true" : "false",
+		        c->isfullscreen ? "true" : "false", c->ishung ? "true" : "false");
+	}
+	fputs("]}", f);
+}
+
+/* The I/O thread subscribes the connection when it reads the line; this
+ * only answers it, in order with the requests before it. */
+void
+querysubscribe(FILE *f, const Arg *arg) {
+	fputs("{\"ok\":true}", f);
+}
+
+void
+querytelemetry(FILE *f, const Arg *arg) {
+	Client **top;
+	Counter *k[6];
+	static const char *names[] = { "configure", "throttled", "property",
+	                               "focussteal", "arrange", "redraw" };
+	unsigned int i, j, n;
+	long t = now();
+
+	fprintf(f, "{\"bar\":{\"requested\":%lu,\"performed\":%lu},\"throttled\":%lu,\"clients\":[",
+	        barrequests, barredraws, configthrottles);
+	if((top = rankclients(&n)))
+		for(i = 0; i < n && i < (unsigned int)(arg->i > 0 ? arg->i : 10); i++) {
+			k[0] = &INFO(top[i])->tm.configs;
+			k[1] = &INFO(top[i])->tm.throttles;
+			k[2] = &INFO(top[i])->tm.props;
+			k[3] = &INFO(top[i])->tm.steals;
+			k[4] = &INFO(top[i])->tm.arranges;
+			k[5] = &INFO(top[i])->tm.redraws;
+			fprintf(f, "%s{\"window\":%lu,\"class\":", i ? "," : "", top[i]->win);
+			jsonstr(f, INFO(top[i])->class);
+			for(j = 0; j < LENGTH(k); j++)
+				fprintf(f, ",\"%s\":[%lu,%lu]", names[j], decayed(k[j], t) >> 8, k[j]->total);
+			fputc('}', f);
+		}
+	fputs("]}", f);
+	free(top);
+}
+#endif /* IPC */
+
+void
+quit(const Arg *arg) {
+	running = False;
+}
+
+/* Returns the clients ordered by their recent event rates, busiest first. */
+Client **
+rankclients(unsigned int *n) {
+	Client **top, *c, *ct;
+	unsigned long *score, tmp;
+	unsigned int i, j;
+	long t = now();
+
+	for(*n = 0, c = mons->clients; c; c = c->next, (*n)++);
+	if(!*n || !(top = calloc(*n, sizeof *top)))
+		return NULL;
+	if(!(score = calloc(*n, sizeof *score))) {
+		free(top);
+		return NULL;
+	}
+	for(i = 0, c = mons->clients; c; c = c->next, i++) {
+		top[i] = c;
+		score[i] = decayed(&INFO(c)->tm.configs, t) + decayed(&INFO(c)->tm.props, t)
+		         + decayed(&INFO(c)->tm.steals, t);
+		for(j = i; j > 0 && score[j - 1] < score[j]; j--) {
+			tmp = score[j];
+			score[j] = score[j - 1];
+			score[j - 1] = tmp;
+			ct = top[j];
+			top[j] = top[j - 1];
+			top[j - 1] = ct;
+		}
+	}
+	free(score);
+	return top;
+}
+
+void
+refreshtitle(Client *c) {
+	if(c->titlestale)
+		updatetitle(c);
+}
+
+/* Refiles c in the edge index of its workspaces once it moved. */
+void
+reindex(Client *c) {
+	ClientInfo *ci = INFO(c);
+	int t;
+
+	if(!c->isindexed || (ci->ix == c->x && ci->iy == c->y
+	&& ci->iw == WIDTH(c) && ci->ih == HEIGHT(c)))
+		return;
+	for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1))
+		fileedges(mons->ws[t], c, False);
+	ci->ix = c->x;
+	ci->iy = c->y;
+	ci->iw = WIDTH(c);
+	ci->ih = HEIGHT(c);
+	for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1))
+		fileedges(mons->ws[t], c, True);
+}
+
+/* Frees workspace t once nothing refers to it anymore. Those named in
+ * tags[] keep their layout state. */
+void
+releasews(unsigned int t) {
+	if(t < LENGTH(tags) || t >= mons->nws || occupied(t)
+	|| hastag(&mons->view, t) || hastag(&mons->prevview, t))
+		return;
+	freews(mons->ws[t]);
+	mons->ws[t] = NULL;
+}
+
 void
-quit(const Arg *arg) {
-	running = False;
+requestbar(void) {
+	if(culprit)
+		count(&INFO(culprit)->tm.redraws);
+	barrequests++;
+	bardirty = True;
 }
 
 void
@@ -1173,24 +3533,33 @@ resize(Client *c, int x, int y, int w, int h, Bool interact) {
 
 void
 resizeclient(Client *c, int x, int y, int w, int h) {
-	XWindowChanges wc;
-
-	c->oldx = c->x; c->x = wc.x = x;
-	c->oldy = c->y; c->y = wc.y = y;
-	c->oldw = c->w; c->w = wc.width = w;
-	c->oldh = c->h; c->h = wc.height = h;
-	wc.border_width = c->bw;
-	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-	configure(c);
-	XSync(dpy, False);
+	c->oldx = c->x; c->x = x;
+	c->oldy = c->y; c->y = y;
+	c->oldw = c->w; c->w = w;
+	c->oldh = c->h; c->h = h;
+	reindex(c);
+#ifdef XSYNC
+	if(c->syncable) {
+		if(c->syncwait) { /* sent once the client caught up */
+			c->syncdirty = True;
+			return;
+		}
+		syncrequest(c);
+	}
+#endif /* XSYNC */
+	configureclient(c);
 }
 
 void
 resizemouse(const Arg *arg) {
 	int ocx, ocy;
-	int nw, nh;
+	int nx, ny, nw, nh, fx = 0, fy = 0, fw = 0, fh = 0;
+	Bool shown = False;
 	Client *c;
 	XEvent ev;
+#ifdef XSYNC
+	XEvent sev;
+#endif /* XSYNC */
 
 	if(!(c = mons->sel))
 		return;
@@ -1212,20 +3581,47 @@ resizemouse(const Arg *arg) {
 			handler[ev.type](&ev);
 			break;
 		case MotionNotify:
+#ifdef XSYNC
+			while(XCheckTypedEvent(dpy, syncevent, &sev))
+				syncalarm(&sev);
+			synctimeouts();
+#endif /* XSYNC */
 			nw = MAX(ev.xmotion.x - ocx - 2 * c->bw + 1, 1);
 			nh = MAX(ev.xmotion.y - ocy - 2 * c->bw + 1, 1);
 			if(mons->wx + nw >= mons->wx && mons->wx + nw <= mons->wx + mons->ww
 			&& mons->wy + nh >= mons->wy && mons->wy + nh <= mons->wy + mons->wh)
 			{
 				if(!c->isfloating && curlayout.arrange != floating
-                && (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
+                && (abs(nw - c->w) > snap || abs(nh - c->h) > snap)) {
+					if(shown)
+						drawoutline(c, fx, fy, fw, fh);
+					shown = False;
 					togglefloating(NULL);
+				}
 			}
-			if(c->isfloating || curlayout.arrange == floating)
+			if(!(c->isfloating || curlayout.arrange == floating))
+				break;
+			if(!outline) {
 				resize(c, c->x, c->y, nw, nh, True);
+				break;
+			}
+			nx = c->x;
+			ny = c->y;
+			applysizehints(c, &nx, &ny, &nw, &nh, True);
+			if(shown)
+				drawoutline(c, fx, fy, fw, fh);
+			else
+				XGrabServer(dpy); /* nothing may paint over the outline */
+			drawoutline(c, fx = nx, fy = ny, fw = nw, fh = nh);
+			shown = True;
 			break;
 		}
 	} while(ev.type != ButtonRelease);
+	if(shown) {
+		drawoutline(c, fx, fy, fw, fh);
+		XUngrabServer(dpy);
+		resize(c, fx, fy, fw, fh, True);
+	}
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(dpy, CurrentTime);
 	while(XCheckMaskEvent(dpy, EnterWindowMask, &ev));
@@ -1237,7 +3633,12 @@ restack(void) {
 	XEvent ev;
 	XWindowChanges wc;
 
-	drawbar();
+	requestbar();
+	if(suspended()) {
+		restackpending = True;
+		return;
+	}
+	restackpending = False;
 	if(!mons->sel)
 		return;
 	if(mons->sel->isfloating || curlayout.arrange == floating)
@@ -1255,14 +3656,312 @@ restack(void) {
 	while(XCheckMaskEvent(dpy, EnterWindowMask, &ev));
 }
 
+void
+restart(const Arg *arg) {
+	restarting = True;
+	running = False;
+}
+
+/* Re-adopts the clients recorded by savestate() in the previous instance.
+ * Only WM_HINTS, size hints and protocols are read back; titles are marked
+ * stale and everything else comes from the saved state. */
+Bool
+restorestate(int fd) {
+	FILE *f;
+	SavedState st;
+	SavedClient sc;
+	SavedWorkspace sw;
+	TagSet ts;
+	unsigned int i, j, t, num;
+	Window d1, d2, *wins = NULL, *stack = NULL, w;
+	XWindowAttributes wa;
+	Client *c, **tail;
+
+	if(!(f = fdopen(fd, "r")))
+		return False;
+	/* a state written by another build is not to be trusted; scan() then
+	 * adopts the windows afresh */
+	if(fread(&st, sizeof st, 1, f) != 1 || memcmp(st.magic, "ldwm", 4)
+	|| st.version != STATEVERSION || st.statesz != sizeof st
+	|| st.wssz != sizeof sw || st.clientsz != sizeof sc
+	|| !XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
+		fclose(f);
+		return False;
+	}
+	for(i = 0; i < st.nws && fread(&sw, sizeof sw, 1, f) == 1; i++)
+		if(sw.tag < maxworkspaces) {
+			getws(sw.tag)->lt = sw.lt < LENGTH(layouts) ? sw.lt : 0;
+			mons->ws[sw.tag]->mfact = sw.mfact;
+			mons->ws[sw.tag]->nmaster = sw.nmaster;
+		}
+	mons->curtag = MIN(st.curtag, maxworkspaces - 1);
+	mons->prevtag = MIN(st.prevtag, maxworkspaces - 1);
+	getws(mons->curtag);
+	getws(mons->prevtag);
+	settag(&mons->view, 0, False);
+	for(i = 0; i < st.nview && fread(&t, sizeof t, 1, f) == 1; i++)
+		if(t < maxworkspaces) {
+			getws(t);
+			settag(&mons->view, t, True);
+		}
+	settag(&mons->view, mons->curtag, True);
+	settag(&mons->prevview, mons->prevtag, True);
+	strncpy(mons->ltsymbol, curlayout.symbol, sizeof mons->ltsymbol);
+	for(tail = &mons->clients; *tail; tail = &(*tail)->next);
+	for(i = 0; i < st.nclients && fread(&sc, sizeof sc, 1, f) == 1; i++) {
+		memset(&ts, 0, sizeof ts);
+		for(j = 0; j < sc.ntags && fread(&t, sizeof t, 1, f) == 1; j++)
+			if(t < maxworkspaces)
+				settag(&ts, t, True);
+		for(j = 0; j < num && wins[j] != sc.win; j++);
+		if(j == num || wintoclient(sc.win) || !XGetWindowAttributes(dpy, sc.win, &wa)
+		|| (wa.map_state != IsViewable && getstate(sc.win) != IconicState)) { /* gone or withdrawn meanwhile */
+			free(ts.more);
+			continue;
+		}
+		if(sc.pool > LENGTH(pools))
+			sc.pool = 0;
+		if(!sc.pool && nexttag(&ts, 0) == -1)
+			settag(&ts, mons->curtag, True);
+		c = allocclient();
+		c->win = sc.win;
+		c->tags = ts;
+		c->isfloating = sc.isfloating;
+		c->isfullscreen = sc.isfullscreen;
+		c->oldstate = sc.oldstate;
+		c->neverfocus = sc.neverfocus;
+		if((c->ispooled = sc.pool > 0))
+			poolready[(INFO(c)->pool = sc.pool - 1)]++;
+		c->x = sc.x; c->y = sc.y; c->w = sc.w; c->h = sc.h;
+		c->oldx = sc.oldx; c->oldy = sc.oldy; c->oldw = sc.oldw; c->oldh = sc.oldh;
+		c->bw = sc.bw;
+		c->oldbw = sc.oldbw;
+		c->titlestale = True;
+		memcpy(INFO(c)->class, sc.class, sizeof sc.class);
+		memcpy(INFO(c)->instance, sc.instance, sizeof sc.instance);
+		INFO(c)->class[sizeof sc.class - 1] = INFO(c)->instance[sizeof sc.instance - 1] = '\0';
+		updatesizehints(c);
+		updatewmhints(c);
+		updateprotocols(c);
+#ifdef XSYNC
+		updatesync(c);
+#endif /* XSYNC */
+		XSelectInput(dpy, c->win, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
+		grabbuttons(c, False);
+		XSetWindowBorder(dpy, c->win, bcolors[1]);
+		*tail = c; /* keep the saved client order */
+		fileclient(c);
+		tail = &c->next;
+	}
+	/* focus history, least recent first */
+	if(st.nclients && (stack = calloc(st.nclients, sizeof *stack)))
+		for(i = 0; i < st.nclients && fread(&w, sizeof w, 1, f) == 1; i++)
+			stack[i] = w;
+	for(i = stack ? st.nclients : 0; i--; )
+		if((c = wintoclient(stack[i])) && !isstacked(c))
+			attachstack(c);
+	for(c = mons->clients; c; c = c->next) /* clients missing from the stack record */
+		if(!isstacked(c))
+			attachstack(c);
+	free(stack);
+	XFree(wins);
+	fclose(f);
+	updateclientlist();
+	mons->sel = wintoclient(st.sel);
+	arrange();
+	focus(mons->sel);
+	return True;
+}
+
+/* Adds c to or removes it from workspace t, keeping the counts current. */
+void
+retag(Client *c, unsigned int t, Bool on) {
+	if(hastag(&c->tags, t) == on)
+		return;
+	settag(&c->tags, t, on);
+	if(on)
+		getws(t)->nclients++;
+	else
+		mons->ws[t]->nclients--;
+	if(c->isindexed)
+		fileedges(mons->ws[t], c, on);
+	if(!on)
+		releasews(t);
+}
+
+#ifdef IPC
+void *
+ringget(Ring *r) {
+	unsigned int head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	void *p;
+
+	if(head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	p = r->slot[head % IPCRING];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return p;
+}
+
+Bool
+ringput(Ring *r, void *p) {
+	unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+	if(tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == IPCRING)
+		return False;
+	r->slot[tail % IPCRING] = p;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return True;
+}
+#endif /* IPC */
+
 void
 run(void) {
 	XEvent ev;
+	fd_set fds;
+	struct timeval tv;
+	struct timespec ts;
+	long wait;
+	long cwait, pwait, fwait;
+#ifdef XSYNC
+	long swait;
+#endif /* XSYNC */
+	int xfd = ConnectionNumber(dpy);
+
 	/* main event loop */
 	XSync(dpy, False);
-	while(running && !XNextEvent(dpy, &ev))
-		if(handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	if(benchmark) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		printf("ldwm: startup: %ld us\n", (ts.tv_sec - started.tv_sec) * 1000000
+		       + (ts.tv_nsec - started.tv_nsec) / 1000);
+		running = False;
+	}
+	while(running) {
+		while(running && XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			if(ev.type < LASTEvent && handler[ev.type]) {
+				handler[ev.type](&ev); /* call handler */
+				culprit = NULL;
+			}
+#ifdef SHM
+			else if(raster.shm && ev.type == raster.event)
+				raster.busy = False;
+#endif /* SHM */
+#ifdef XSYNC
+			else if(synced && ev.type == syncevent)
+				syncalarm(&ev);
+#endif /* XSYNC */
+		}
+		if(!running)
+			break;
+		if(reaped)
+			prunepools();
+		fwait = flushfocus();
+		/* catch up on what was held back while a fullscreen client had
+		 * focus, unless the handlers did already */
+		if(!suspended()) {
+			if(arrangepending)
+				arrange();
+			else if(restackpending)
+				restack();
+		}
+		/* redraws requested since the last frame are rendered at most
+		 * once per barinterval */
+		wait = flushbar();
+		if(fwait >= 0 && (wait < 0 || fwait < wait))
+			wait = fwait;
+		if(nconfigwait && (cwait = flushconfigs()) >= 0 && (wait < 0 || cwait < wait))
+			wait = cwait;
+		if((pwait = pingclients()) >= 0 && (wait < 0 || pwait < wait))
+			wait = pwait;
+#ifdef XSYNC
+		if(nsyncwait && (swait = synctimeouts()) >= 0 && (wait < 0 || swait < wait))
+			wait = swait;
+#endif /* XSYNC */
+#ifdef IPC
+		if(ipcfd >= 0)
+			flushevents();
+#endif /* IPC */
+		if(XPending(dpy))
+			continue;
+		FD_ZERO(&fds);
+		FD_SET(xfd, &fds);
+#ifdef IPC
+		if(ipcfd >= 0)
+			FD_SET(ipcreqfd, &fds);
+#endif /* IPC */
+		tv.tv_sec = wait / 1000;
+		tv.tv_usec = wait % 1000 * 1000;
+#ifdef IPC
+		if(select(MAX(xfd, ipcreqfd) + 1, &fds, NULL, NULL, wait < 0 ? NULL : &tv) > 0
+		&& ipcfd >= 0 && FD_ISSET(ipcreqfd, &fds))
+			ipcdispatch();
+#else
+		select(xfd + 1, &fds, NULL, NULL, wait < 0 ? NULL : &tv);
+#endif /* IPC */
+	}
+}
+
+/* Writes the state restorestate() needs to an unlinked file and returns
+ * its descriptor, which survives exec(). */
+int
+savestate(void) {
+	FILE *f;
+	SavedState st = { { 'l', 'd', 'w', 'm' }, STATEVERSION,
+	                  sizeof(SavedState), sizeof(SavedWorkspace), sizeof(SavedClient) };
+	SavedWorkspace sw;
+	SavedClient sc;
+	unsigned int i;
+	Client *c;
+	int fd, t;
+
+	if(!(f = tmpfile()))
+		return -1;
+	for(i = 0; i < mons->nws; i++)
+		st.nws += mons->ws[i] != NULL;
+	st.curtag = mons->curtag;
+	st.prevtag = mons->prevtag;
+	st.sel = mons->sel ? mons->sel->win : None;
+	for(t = nexttag(&mons->view, 0); t != -1; t = nexttag(&mons->view, t + 1), st.nview++);
+	for(c = mons->clients; c; c = c->next, st.nclients++);
+	fwrite(&st, sizeof st, 1, f);
+	for(i = 0; i < mons->nws; i++)
+		if(mons->ws[i]) {
+			sw.tag = i;
+			sw.lt = mons->ws[i]->lt;
+			sw.mfact = mons->ws[i]->mfact;
+			sw.nmaster = mons->ws[i]->nmaster;
+			fwrite(&sw, sizeof sw, 1, f);
+		}
+	for(t = nexttag(&mons->view, 0); t != -1; t = nexttag(&mons->view, t + 1))
+		fwrite(&t, sizeof t, 1, f);
+	for(c = mons->clients; c; c = c->next) {
+		memset(&sc, 0, sizeof sc);
+		sc.win = c->win;
+		for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1), sc.ntags++);
+		sc.isfloating = c->isfloating;
+		sc.isfullscreen = c->isfullscreen;
+		sc.oldstate = c->oldstate;
+		sc.neverfocus = c->neverfocus;
+		sc.pool = c->ispooled ? INFO(c)->pool + 1 : 0;
+		sc.x = c->x; sc.y = c->y; sc.w = c->w; sc.h = c->h;
+		sc.oldx = c->oldx; sc.oldy = c->oldy; sc.oldw = c->oldw; sc.oldh = c->oldh;
+		sc.bw = c->bw;
+		sc.oldbw = c->oldbw;
+		strncpy(sc.class, INFO(c)->class, sizeof sc.class - 1);
+		strncpy(sc.instance, INFO(c)->instance, sizeof sc.instance - 1);
+		fwrite(&sc, sizeof sc, 1, f);
+		for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1))
+			fwrite(&t, sizeof t, 1, f);
+	}
+	for(c = mons->stack; c; c = c->snext)
+		fwrite(&c->win, sizeof c->win, 1, f);
+	if(fflush(f) || (fd = dup(fileno(f))) == -1) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	lseek(fd, 0, SEEK_SET);
+	return fd;
 }
 
 void
@@ -1273,6 +3972,8 @@ scan(void) {
 
 	if(XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
 		for(i = 0; i < num; i++) {
+			if(wintoclient(wins[i])) /* restored */
+				continue;
 			if(!XGetWindowAttributes(dpy, wins[i], &wa)
 			|| wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
 				continue;
@@ -1280,7 +3981,7 @@ scan(void) {
 				manage(wins[i], &wa);
 		}
 		for(i = 0; i < num; i++) { /* now the transients */
-			if(!XGetWindowAttributes(dpy, wins[i], &wa))
+			if(wintoclient(wins[i]) || !XGetWindowAttributes(dpy, wins[i], &wa))
 				continue;
 			if(XGetTransientForHint(dpy, wins[i], &d1)
 			&& (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
@@ -1364,10 +4065,12 @@ setfullscreen(Client *c, Bool fullscreen) {
 
 void
 setlayout(const Arg *arg) {
+	if(arg->i < -1 || arg->i >= (int)LENGTH(layouts))
+		return;
     if(arg->i == -1) /* special case -- cycle through layouts */
-        mons->lt[mons->curtag] = (mons->lt[mons->curtag] + 1) % LENGTH(layouts);
+        curws->lt = (curws->lt + 1) % LENGTH(layouts);
     else
-        mons->lt[mons->curtag] = arg->i;
+        curws->lt = arg->i;
 
 	strncpy(mons->ltsymbol, curlayout.symbol, sizeof mons->ltsymbol);
 	arrange();
@@ -1378,15 +4081,53 @@ setmfact(const Arg *arg) {
     if (curlayout.arrange == floating)
         return;
 
-    mons->mfact[mons->curtag] += arg->f;
-    if (mons->mfact[mons->curtag] > 0.9) mons->mfact[mons->curtag] = 0.9;
-    if (mons->mfact[mons->curtag] < 0.1) mons->mfact[mons->curtag] = 0.1;
+    curws->mfact += arg->f;
+    if (curws->mfact > 0.9) curws->mfact = 0.9;
+    if (curws->mfact < 0.1) curws->mfact = 0.1;
 	arrange();
 }
 
+/* remembers the geometry c was last told about */
+void
+setsent(Client *c) {
+	INFO(c)->sentx = c->x;
+	INFO(c)->senty = c->y;
+	INFO(c)->sentw = c->w;
+	INFO(c)->senth = c->h;
+	INFO(c)->sentbw = c->bw;
+}
+
+void
+settag(TagSet *s, unsigned int t, Bool on) {
+	unsigned long *word = &s->w;
+	unsigned int n;
+
+	if(t >= TAGBITS) {
+		t -= TAGBITS;
+		if(t / TAGBITS >= s->nmore) {
+			if(!on)
+				return;
+			n = t / TAGBITS + 1;
+			if(!(s->more = realloc(s->more, n * sizeof *s->more)))
+				die("fatal: could not malloc() %u bytes\n", n * sizeof *s->more);
+			memset(s->more + s->nmore, 0, (n - s->nmore) * sizeof *s->more);
+			s->nmore = n;
+		}
+		word = &s->more[t / TAGBITS];
+		t %= TAGBITS;
+	}
+	if(on)
+		*word |= 1UL << t;
+	else
+		*word &= ~(1UL << t);
+}
+
 void
 setup(void) {
 	XSetWindowAttributes wa;
+	XGCValues gcv;
+	const char *names[WMLast + NetLast + XLast];
+	Atom atoms[LENGTH(names)];
 
 	/* clean up any zombies immediately */
 	sigchld(0);
@@ -1394,24 +4135,30 @@ setup(void) {
 	/* init screen */
 	screen = DefaultScreen(dpy);
 	root = RootWindow(dpy, screen);
+	/* a core font only gets queried once the atoms and colors are done */
 	initfont(font);
 	sw = DisplayWidth(dpy, screen);
 	sh = DisplayHeight(dpy, screen);
-	bh = dc.h = dc.font.height + 2;
-	updategeom();
-	/* init atoms */
-	wmatom[WMProtocols]            = XInternAtom(dpy, "WM_PROTOCOLS", False);
-	wmatom[WMDelete]               = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
-	wmatom[WMState]                = XInternAtom(dpy, "WM_STATE", False);
-	wmatom[WMTakeFocus]            = XInternAtom(dpy, "WM_TAKE_FOCUS", False);
-	netatom[NetActiveWindow]       = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-	netatom[NetSupported]          = XInternAtom(dpy, "_NET_SUPPORTED", False);
-	netatom[NetWMName]             = XInternAtom(dpy, "_NET_WM_NAME", False);
-	netatom[NetWMState]            = XInternAtom(dpy, "_NET_WM_STATE", False);
-	netatom[NetWMFullscreen]       = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
-	netatom[NetWMWindowType]       = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
-	netatom[NetClientList]         = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	/* init atoms, in one round-trip */
+	memcpy(names, wmnames, sizeof wmnames);
+	memcpy(names + WMLast, netnames, sizeof netnames);
+	memcpy(names + WMLast + NetLast, xnames, sizeof xnames);
+	if(!XInternAtoms(dpy, (char **)names, LENGTH(names), False, atoms))
+		die("error, cannot intern atoms\n");
+	memcpy(wmatom, atoms, sizeof wmatom);
+	memcpy(netatom, atoms + WMLast, sizeof netatom);
+	memcpy(xatom, atoms + WMLast + NetLast, sizeof xatom);
+#ifdef XSYNC
+	{
+		int major, minor;
+
+		if(XSyncQueryExtension(dpy, &syncevent, &syncerror)
+		&& XSyncInitialize(dpy, &major, &minor)) {
+			syncevent += XSyncAlarmNotify;
+			synced = True;
+		}
+	}
+#endif /* XSYNC */
 	/* init cursors */
 	cursor[CurNormal] = XCreateFontCursor(dpy, XC_left_ptr);
 	cursor[CurResize] = XCreateFontCursor(dpy, XC_sizing);
@@ -1426,13 +4173,29 @@ setup(void) {
 		scolors[i][ColFG] = getcolor(statuscolors[i][ColFG]);
 		scolors[i][ColBG] = getcolor(statuscolors[i][ColBG]);
 	}
+	finishfont(font);
+	bh = dc.h = dc.font.height + 2;
+	updategeom();
 	dc.drawable = XCreatePixmap(dpy, root, DisplayWidth(dpy, screen), bh, DefaultDepth(dpy, screen));
 	dc.gc = XCreateGC(dpy, root, 0, NULL);
 	XSetLineAttributes(dpy, dc.gc, 1, LineSolid, CapButt, JoinMiter);
-	if(!dc.font.set)
+	gcv.function = GXxor;
+	gcv.subwindow_mode = IncludeInferiors;
+	gcv.foreground = WhitePixel(dpy, screen) ^ BlackPixel(dpy, screen);
+	gcv.line_width = MAX(borderpx, 1);
+	outlinegc = XCreateGC(dpy, root, GCFunction|GCSubwindowMode|GCForeground|GCLineWidth, &gcv);
+	if(dc.font.xfont)
 		XSetFont(dpy, dc.gc, dc.font.xfont->fid);
+#ifdef XFT
+	if(dc.font.xft)
+		dc.xftdraw = XftDrawCreate(dpy, dc.drawable, DefaultVisual(dpy, screen),
+		                           DefaultColormap(dpy, screen));
+#endif /* XFT */
 	/* init bars */
 	updatebars();
+#ifdef SHM
+	initraster();
+#endif /* SHM */
     updatestatus();
 	/* EWMH support per view */
 	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
@@ -1445,6 +4208,9 @@ setup(void) {
 	XChangeWindowAttributes(dpy, root, CWEventMask|CWCursor, &wa);
 	XSelectInput(dpy, root, wa.event_mask);
 	grabkeys();
+#ifdef IPC
+	initipc();
+#endif /* IPC */
 }
 
 void
@@ -1467,31 +4233,348 @@ void
 sigchld(int unused) {
 	if(signal(SIGCHLD, sigchld) == SIG_ERR)
 		die("Can't install SIGCHLD handler");
-	while(0 < waitpid(-1, NULL, WNOHANG));
+	while(0 < waitpid(-1, NULL, WNOHANG))
+		reaped = True;
+}
+
+/* Returns how far to move c, about to go to x, y, along the x axis or, if
+ * vertical, the y axis so that one of its sides lines up with a side of a
+ * visible window nearby, or 0 if none is within snap pixels. */
+int
+snapedge(Client *c, int x, int y, Bool vertical) {
+	Workspace *ws;
+	ClientInfo *oi;
+	Edge *e;
+	int t, j, lo, hi, d, best = snap;
+	int mine[2] = { vertical ? y : x, vertical ? y + HEIGHT(c) : x + WIDTH(c) };
+	int from = vertical ? x : y, to = vertical ? x + WIDTH(c) : y + HEIGHT(c);
+	unsigned int i;
+
+	for(t = nexttag(&mons->view, 0); t != -1; t = nexttag(&mons->view, t + 1)) {
+		if(t >= mons->nws || !(ws = mons->ws[t]))
+			continue;
+		e = vertical ? ws->yedges : ws->xedges;
+		for(j = 0; j < 2; j++)
+			for(i = edgesearch(e, ws->nedges, mine[j] - (int)snap + 1);
+			    i < ws->nedges && e[i].pos < mine[j] + (int)snap; i++) {
+				if(e[i].c == c || e[i].c->isfullscreen)
+					continue;
+				oi = INFO(e[i].c);
+				lo = vertical ? oi->ix : oi->iy;
+				hi = lo + (vertical ? oi->iw : oi->ih);
+				if(hi + (int)snap <= from || lo - (int)snap >= to) /* not side by side */
+					continue;
+				if(abs(d = e[i].pos - mine[j]) < abs(best))
+					best = d;
+			}
+	}
+	return abs(best) < (int)snap ? best : 0;
 }
 
+/* Hands out a waiting window of the pool that owns arg->v, if any, and
+ * tops the pool up again in the background. */
 void
 spawn(const Arg *arg) {
-	if(fork() == 0) {
-		if(dpy)
-			close(ConnectionNumber(dpy));
-		setsid();
-		execvp(((char **)arg->v)[0], (char **)arg->v);
-		fprintf(stderr, "ldwm: execvp %s", ((char **)arg->v)[0]);
-		perror(" failed");
-		exit(EXIT_SUCCESS);
+	unsigned int i;
+	Client *c;
+
+	for(i = 0; i < LENGTH(pools) && pools[i].cmd != arg->v; i++);
+	if(i == LENGTH(pools)) {
+		launch((const char **)arg->v);
+		return;
+	}
+	for(c = mons->stack; c && !(c->ispooled && INFO(c)->pool == i); c = c->snext);
+	if(c)
+		unpool(c);
+	else
+		poolwant[i]++; /* the next one to map is handed out right away */
+	fillpool(i);
+}
+
+/* While the selected client is fullscreen it covers the bar and every
+ * other client on the tag, so redraws, arranges and restacks are held
+ * back until it leaves fullscreen or loses focus. */
+Bool
+suspended(void) {
+	return mons->sel && mons->sel->isfullscreen && ISVISIBLE(mons->sel);
+}
+
+/* Takes the keyboard and lists the clients in the bar, those focused last
+ * first. Typing narrows them to the fuzzy matches of what was typed,
+ * Tab and the arrows pick one, Return jumps to it and Escape gives up. */
+void
+switcher(const Arg *arg) {
+	if(switching || XGrabKeyboard(dpy, root, True, GrabModeAsync, GrabModeAsync,
+	CurrentTime) != GrabSuccess)
+		return;
+	switching = True;
+	querylen = 0;
+	query[0] = '\0';
+	switcherscan(False);
+	XRaiseWindow(dpy, mons->barwin);
+	requestbar();
+}
+
+void
+switcherdrop(Client *c) {
+	unsigned int i;
+
+	for(i = 0; i < nhits && hits[i].c != c; i++);
+	if(i == nhits)
+		return;
+	memmove(hits + i, hits + i + 1, (nhits - i - 1) * sizeof *hits);
+	if(--nhits && hitsel >= nhits)
+		hitsel = nhits - 1;
+	requestbar();
+}
+
+void
+switcherkey(XKeyEvent *ev) {
+	char buf[32];
+	KeySym keysym;
+	Client *c = NULL;
+	Arg a;
+	int n;
+
+	n = XLookupString(ev, buf, sizeof buf, &keysym, NULL);
+	switch(keysym) {
+	case XK_Return:
+	case XK_KP_Enter:
+		if(nhits)
+			c = hits[hitsel].c;
+		/* fallthrough */
+	case XK_Escape:
+		XUngrabKeyboard(dpy, CurrentTime);
+		switching = False;
+		nhits = 0;
+		requestbar();
+		if(!c) {
+			restack();
+			return;
+		}
+		if(!ISVISIBLE(c)) {
+			a.i = nexttag(&c->tags, 0);
+			view(&a);
+		}
+		pop(c);
+		return;
+	case XK_BackSpace:
+		if(!querylen)
+			return;
+		query[--querylen] = '\0';
+		switcherscan(False);
+		break;
+	case XK_Tab:
+	case XK_Right:
+	case XK_Down:
+		if(nhits)
+			hitsel = (hitsel + 1) % nhits;
+		break;
+	case XK_ISO_Left_Tab:
+	case XK_Left:
+	case XK_Up:
+		if(nhits)
+			hitsel = (hitsel + nhits - 1) % nhits;
+		break;
+	default:
+		if(n != 1 || iscntrl((unsigned char)buf[0]) || querylen + 1 >= sizeof query)
+			return;
+		query[querylen++] = tolower((unsigned char)buf[0]);
+		query[querylen] = '\0';
+		switcherscan(True); /* a longer query only ever drops hits */
+	}
+	requestbar();
+}
+
+/* Scores the clients against query, only those hit before if narrow, and
+ * sorts them into hits. */
+void
+switcherscan(Bool narrow) {
+	Client *c;
+	ClientInfo *ci;
+	unsigned long long need = 0;
+	unsigned int i, n, order;
+	int score, f;
+
+	for(i = 0; i < querylen; i++)
+		need |= LETTER(query[i]);
+	if(!narrow) {
+		for(n = 0, c = mons->stack; c; c = c->snext, n++);
+		if(n > hitsz) {
+			hitsz = MAX(n, hitsz * 2);
+			if(!(hits = realloc(hits, hitsz * sizeof *hits)))
+				die("fatal: could not malloc() %u bytes\n", hitsz * sizeof *hits);
+		}
+		for(nhits = 0, order = 0, c = mons->stack; c; c = c->snext, order++)
+			if(!c->ispooled) {
+				refreshtitle(c);
+				hits[nhits].c = c;
+				hits[nhits++].order = order;
+			}
+	}
+	for(i = n = 0; i < nhits; i++) {
+		ci = INFO(hits[i].c);
+		if((ci->letters & need) != need)
+			continue;
+		score = fuzzy(ci->name, query, querylen);
+		if((f = fuzzy(ci->class, query, querylen)) >= 0 && (score < 0 || f + 1 < score))
+			score = f + 1;
+		if((f = fuzzy(ci->instance, query, querylen)) >= 0 && (score < 0 || f + 1 < score))
+			score = f + 1;
+		if(score < 0)
+			continue;
+		hits[n] = hits[i];
+		hits[n++].score = score;
+	}
+	nhits = n;
+	qsort(hits, nhits, sizeof *hits, hitcmp);
+	hitsel = 0;
+}
+
+#ifdef XSYNC
+void
+syncalarm(XEvent *e) {
+	XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+	Client *c;
+
+	for(c = mons->clients; c && INFO(c)->alarm != ev->alarm; c = c->next);
+	if(!c || !c->syncwait)
+		return;
+	c->syncwait = False;
+	nsyncwait--;
+	if(c->syncdirty) { /* catch up with the latest geometry */
+		c->syncdirty = False;
+		syncrequest(c);
+		configureclient(c);
+	}
+}
+
+/* Bumps the client's sync counter target and arms an alarm that fires once
+ * the client has painted the configure that follows. */
+void
+syncrequest(Client *c) {
+	ClientInfo *ci = INFO(c);
+	XSyncValue one;
+	XSyncAlarmAttributes aa;
+	XEvent ev;
+	Bool overflow;
+
+	XSyncIntToValue(&one, 1);
+	XSyncValueAdd(&ci->value, ci->value, one, &overflow);
+	ev.type = ClientMessage;
+	ev.xclient.window = c->win;
+	ev.xclient.message_type = wmatom[WMProtocols];
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = netatom[NetWMSyncRequest];
+	ev.xclient.data.l[1] = CurrentTime;
+	ev.xclient.data.l[2] = XSyncValueLow32(ci->value);
+	ev.xclient.data.l[3] = XSyncValueHigh32(ci->value);
+	ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+	aa.trigger.counter = ci->counter;
+	aa.trigger.value_type = XSyncAbsolute;
+	aa.trigger.wait_value = ci->value;
+	aa.trigger.test_type = XSyncPositiveComparison;
+	aa.events = True;
+	if(ci->alarm)
+		XSyncChangeAlarm(dpy, ci->alarm, XSyncCACounter|XSyncCAValueType|XSyncCAValue
+		                 |XSyncCATestType|XSyncCAEvents, &aa);
+	else
+		ci->alarm = XSyncCreateAlarm(dpy, XSyncCACounter|XSyncCAValueType|XSyncCAValue
+		                             |XSyncCATestType|XSyncCAEvents, &aa);
+	c->syncwait = True;
+	ci->syncsent = now();
+	nsyncwait++;
+}
+
+/* Releases clients that did not answer within synctimeout and returns the
+ * time until the next one expires, -1 if none is waiting. */
+long
+synctimeouts(void) {
+	long t = now(), left, wait = -1;
+	Client *c;
+
+	for(c = mons->clients; c; c = c->next) {
+		if(!c->syncwait)
+			continue;
+		if((left = INFO(c)->syncsent + synctimeout - t) > 0) {
+			wait = (wait < 0 || left < wait) ? left : wait;
+			continue;
+		}
+		c->syncwait = False;
+		nsyncwait--;
+		if(c->syncdirty) {
+			c->syncdirty = False;
+			configureclient(c);
+		}
 	}
+	return wait;
 }
+#endif /* XSYNC */
 
 void
 tag(const Arg *arg) {
-	if(mons->sel && arg->i < LENGTH(tags)) {
-		mons->sel->tag = arg->i;
+	Client *c = mons->sel;
+	int t;
+
+	if(c && arg->i >= 0 && arg->i < maxworkspaces) {
+		retag(c, arg->i, True);
+		for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1))
+			if(t != arg->i)
+				retag(c, t, False);
+		notify("tag", c);
 		focus(NULL);
 		arrange();
 	}
 }
 
+const char *
+tagname(unsigned int t) {
+	static char buf[12];
+
+	if(t < LENGTH(tags))
+		return tags[t];
+	snprintf(buf, sizeof buf, "%u", t + 1);
+	return buf;
+}
+
+/* Prints how many bar redraws were asked for and done and how many configure
+ * requests were throttled, and lists the arg->i clients with the highest
+ * recent event rates on stderr. */
+void
+telemetry(const Arg *arg) {
+	Client **top;
+	Telemetry *tm;
+	unsigned int i, j, n;
+	long t = now();
+	char *name;
+
+	fprintf(stderr, "ldwm: bar redraws: %lu requested, %lu performed\n",
+	        barrequests, barredraws);
+	fprintf(stderr, "ldwm: configure requests throttled: %lu\n", configthrottles);
+	if(!(top = rankclients(&n)))
+		return;
+	fprintf(stderr, "ldwm: %-16s %-10s %15s %15s %15s %15s %15s %15s  recent/total\n",
+	        "class", "window", "configure", "throttled", "property", "focus steal", "arrange", "redraw");
+	for(i = 0; i < n && i < (unsigned int)MAX(arg->i, 1); i++) {
+		tm = &INFO(top[i])->tm;
+		fprintf(stderr, "ldwm: %-16.16s 0x%08lx", INFO(top[i])->class, top[i]->win);
+		fprintf(stderr, " %7lu/%-7lu", decayed(&tm->configs, t) >> 8, tm->configs.total);
+		fprintf(stderr, " %7lu/%-7lu", decayed(&tm->throttles, t) >> 8, tm->throttles.total);
+		fprintf(stderr, " %7lu/%-7lu", decayed(&tm->props, t) >> 8, tm->props.total);
+		fprintf(stderr, " %7lu/%-7lu", decayed(&tm->steals, t) >> 8, tm->steals.total);
+		fprintf(stderr, " %7lu/%-7lu", decayed(&tm->arranges, t) >> 8, tm->arranges.total);
+		fprintf(stderr, " %7lu/%-7lu\n", decayed(&tm->redraws, t) >> 8, tm->redraws.total);
+		for(j = 0; j < PROPSLOTS; j++)
+			if(tm->prop[j].k.total && (name = XGetAtomName(dpy, tm->prop[j].atom))) {
+				fprintf(stderr, "ldwm:   %-40s %7lu/%-7lu\n", name,
+				        decayed(&tm->prop[j].k, t) >> 8, tm->prop[j].k.total);
+				XFree(name);
+			}
+	}
+	free(top);
+}
+
 int
 textnw(const char *text, unsigned int len) {
     // remove non-printing characters before calculating width
@@ -1512,6 +4595,14 @@ textnw(const char *text, unsigned int len) {
     }
     buf[ibuf]=0;
 
+#ifdef XFT
+	if(dc.font.xft) {
+		XGlyphInfo ext;
+
+		XftTextExtentsUtf8(dpy, dc.font.xft, (XftChar8 *)buf, lenbuf, &ext);
+		return ext.xOff;
+	}
+#endif /* XFT */
 	if(dc.font.set) {
 		XmbTextExtents(dc.font.set, buf, lenbuf, NULL, &r);
 		return r.width;
@@ -1521,12 +4612,12 @@ textnw(const char *text, unsigned int len) {
 
 void
 tile(void) {
-	unsigned int i, n, h, mw, my, ty, nm = mons->nmaster[mons->curtag];
+	unsigned int i, n, h, mw, my, ty, nm = curws->nmaster;
 	Client *c;
 
 	for(n = 0, c = nexttiled(mons->clients); c; c = nexttiled(c->next), n++);
 
-    mw = (n > nm) ? mons->ww * mons->mfact[mons->curtag] : mons->ww;
+    mw = (n > nm) ? mons->ww * curws->mfact : mons->ww;
 	if (nm == 0) mw = 0;
 
 	for(i = my = ty = 0, c = nexttiled(mons->clients); c; c = nexttiled(c->next), i++)
@@ -1546,12 +4637,12 @@ tile(void) {
 
 void
 tilegap(void) {
-	unsigned int i, n, h, mw, my, ty, nm = mons->nmaster[mons->curtag];
+	unsigned int i, n, h, mw, my, ty, nm = curws->nmaster;
 	Client *c;
 
 	for(n = 0, c = nexttiled(mons->clients); c; c = nexttiled(c->next), n++);
 
-    mw = (n > nm) ? mons->ww * mons->mfact[mons->curtag] : mons->ww;
+    mw = (n > nm) ? mons->ww * curws->mfact : mons->ww;
 	if (nm == 0) mw = 0;
     
 	for(i = my = ty = 0, c = nexttiled(mons->clients); c; c = nexttiled(c->next), i++)
@@ -1569,6 +4660,12 @@ tilegap(void) {
 		}
 }
 
+void
+throttled(Client *c) {
+	configthrottles++;
+	count(&INFO(c)->tm.throttles);
+}
+
 void
 togglefloating(const Arg *arg) {
 	if(!mons->sel || mons->sel->isfullscreen) /* no support for fullscreen windows */
@@ -1579,6 +4676,42 @@ togglefloating(const Arg *arg) {
 	arrange();
 }
 
+void
+toggletag(const Arg *arg) {
+	Client *c = mons->sel;
+
+	if(c && arg->i >= 0 && arg->i < maxworkspaces && !onlytag(&c->tags, arg->i)) {
+		retag(c, arg->i, !hastag(&c->tags, arg->i));
+		notify("tag", c);
+		focus(NULL);
+		arrange();
+	}
+}
+
+void
+toggleview(const Arg *arg) {
+	Client *c;
+
+	if(arg->i < 0 || arg->i >= maxworkspaces || onlytag(&mons->view, arg->i))
+		return;
+	if(hastag(&mons->view, arg->i)) {
+		settag(&mons->view, arg->i, False);
+		if(mons->curtag == arg->i)
+			mons->curtag = nexttag(&mons->view, 0);
+		releasews(arg->i);
+	}
+	else {
+		getws(arg->i);
+		settag(&mons->view, arg->i, True);
+	}
+	for(c = mons->clients; c; c = c->next)
+		if(ISVISIBLE(c))
+			refreshtitle(c);
+	notify("view", NULL);
+	focus(NULL);
+	arrange();
+}
+
 void
 unfocus(Client *c, Bool setfocus) {
 	if(!c)
@@ -1594,10 +4727,30 @@ unfocus(Client *c, Bool setfocus) {
 void
 unmanage(Client *c, Bool destroyed) {
 	XWindowChanges wc;
+	int t;
 
+	notify("unmanage", c);
 	/* The server grab construct avoids race conditions. */
 	detach(c);
 	detachstack(c);
+	if(c == culprit)
+		culprit = NULL;
+	if(c == pendingfocus)
+		pendingfocus = NULL;
+	if(switching)
+		switcherdrop(c);
+	if(c->configwait)
+		nconfigwait--;
+	if(c->ispooled) /* refilled by the next spawn() */
+		poolready[INFO(c)->pool]--;
+	for(t = nexttag(&c->tags, 0); t != -1; t = nexttag(&c->tags, t + 1))
+		releasews(t);
+#ifdef XSYNC
+	if(c->syncwait)
+		nsyncwait--;
+	if(INFO(c)->alarm)
+		XSyncDestroyAlarm(dpy, INFO(c)->alarm);
+#endif /* XSYNC */
 	if(!destroyed) {
 		wc.border_width = c->oldbw;
 		XGrabServer(dpy);
@@ -1609,7 +4762,7 @@ unmanage(Client *c, Bool destroyed) {
 		XSetErrorHandler(xerror);
 		XUngrabServer(dpy);
 	}
-	free(c);
+	freeclient(c);
 	focus(NULL);
 	updateclientlist();
 	arrange();
@@ -1628,12 +4781,23 @@ unmapnotify(XEvent *e) {
 	}
 }
 
+void
+unpool(Client *c) {
+	c->ispooled = False;
+	poolready[INFO(c)->pool]--;
+	retag(c, mons->curtag, True);
+	notify("manage", c);
+	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
+	                (unsigned char *) &(c->win), 1);
+	pop(c);
+}
+
 void
 updatebars(void) {
 	XSetWindowAttributes wa = {
 		.override_redirect = True,
 		.background_pixmap = ParentRelative,
-		.event_mask = ButtonPressMask|ExposureMask
+		.event_mask = ButtonPressMask|EnterWindowMask|ExposureMask
 	};
 	
     if (mons->barwin)
@@ -1650,14 +4814,19 @@ updateclientlist() {
 	Client *c;
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
 		for(c = mons->clients; c; c = c->next)
-			XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend, (unsigned char *) &(c->win), 1);
+			if(!c->ispooled)
+				XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend, (unsigned char *) &(c->win), 1);
 }
 
 Bool
 updategeom(void) {
 	Bool dirty = False;
-	if(!mons)
+	if(!mons) {
 		mons = createmon();
+		settag(&mons->view, 0, True);
+		settag(&mons->prevview, 0, True);
+		strncpy(mons->ltsymbol, layouts[getws(0)->lt].symbol, sizeof mons->ltsymbol);
+	}
 	if(mons->mw != sw || mons->mh != sh) {
 		dirty = True;
 		mons->mw = mons->ww = sw;
@@ -1684,68 +4853,120 @@ updatenumlockmask(void) {
 	XFreeModifiermap(modmap);
 }
 
+void
+updateprotocols(Client *c) {
+	Atom *protocols;
+	int n;
+
+	c->canping = False;
+	if(XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+		while(!c->canping && n--)
+			c->canping = protocols[n] == netatom[NetWMPing];
+		XFree(protocols);
+	}
+	if(!c->canping)
+		c->pingwait = c->ishung = False;
+}
+
 void
 updatesizehints(Client *c) {
 	long msize;
 	XSizeHints size;
+	ClientInfo *ci = INFO(c);
 
 	if(!XGetWMNormalHints(dpy, c->win, &size, &msize))
 		/* size is uninitialized, ensure that size.flags aren't used */
 		size.flags = PSize;
+	ci->hints = size.flags;
 	if(size.flags & PBaseSize) {
-		c->basew = size.base_width;
-		c->baseh = size.base_height;
+		ci->basew = size.base_width;
+		ci->baseh = size.base_height;
 	}
 	else if(size.flags & PMinSize) {
-		c->basew = size.min_width;
-		c->baseh = size.min_height;
+		ci->basew = size.min_width;
+		ci->baseh = size.min_height;
 	}
 	else
-		c->basew = c->baseh = 0;
+		ci->basew = ci->baseh = 0;
 	if(size.flags & PResizeInc) {
-		c->incw = size.width_inc;
-		c->inch = size.height_inc;
+		ci->incw = size.width_inc;
+		ci->inch = size.height_inc;
 	}
 	else
-		c->incw = c->inch = 0;
+		ci->incw = ci->inch = 0;
 	if(size.flags & PMaxSize) {
-		c->maxw = size.max_width;
-		c->maxh = size.max_height;
+		ci->maxw = size.max_width;
+		ci->maxh = size.max_height;
 	}
 	else
-		c->maxw = c->maxh = 0;
+		ci->maxw = ci->maxh = 0;
 	if(size.flags & PMinSize) {
-		c->minw = size.min_width;
-		c->minh = size.min_height;
+		ci->minw = size.min_width;
+		ci->minh = size.min_height;
 	}
 	else if(size.flags & PBaseSize) {
-		c->minw = size.base_width;
-		c->minh = size.base_height;
+		ci->minw = size.base_width;
+		ci->minh = size.base_height;
 	}
 	else
-		c->minw = c->minh = 0;
+		ci->minw = ci->minh = 0;
 	if(size.flags & PAspect) {
-		c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-		c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
+		ci->mina = (float)size.min_aspect.y / size.min_aspect.x;
+		ci->maxa = (float)size.max_aspect.x / size.max_aspect.y;
 	}
 	else
-		c->maxa = c->mina = 0.0;
-	c->isfixed = (c->maxw && c->minw && c->maxh && c->minh
-	             && c->maxw == c->minw && c->maxh == c->minh);
+		ci->maxa = ci->mina = 0.0;
+	c->isfixed = (ci->maxw && ci->minw && ci->maxh && ci->minh
+	             && ci->maxw == ci->minw && ci->maxh == ci->minh);
 }
 
 void updatestatus(void) {
 	if(!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
 	    strcpy(stext, "ldwm-"VERSION);
-	drawbar();
+	requestbar();
+}
+
+#ifdef XSYNC
+void
+updatesync(Client *c) {
+	ClientInfo *ci = INFO(c);
+	Atom *protocols;
+	unsigned char *p = NULL;
+	unsigned long n, extra;
+	int i, format;
+	Atom type;
+	Bool proto = False;
+
+	c->syncable = False;
+	if(!synced)
+		return;
+	if(XGetWMProtocols(dpy, c->win, &protocols, &i)) {
+		while(!proto && i--)
+			proto = protocols[i] == netatom[NetWMSyncRequest];
+		XFree(protocols);
+	}
+	ci->counter = None;
+	if(proto && XGetWindowProperty(dpy, c->win, netatom[NetWMSyncRequestCounter], 0L, 1L,
+	                               False, XA_CARDINAL, &type, &format, &n, &extra, &p) == Success && p) {
+		if(n == 1 && format == 32)
+			ci->counter = *(unsigned long *)p;
+		XFree(p);
+	}
+	if(ci->counter && XSyncQueryCounter(dpy, ci->counter, &ci->value))
+		c->syncable = True;
 }
+#endif /* XSYNC */
 
 void
 updatetitle(Client *c) {
-	if(!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-		gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-	if(c->name[0] == '\0') /* hack to mark broken clients */
-		strcpy(c->name, broken);
+	ClientInfo *ci = INFO(c);
+
+	c->titlestale = False;
+	if(!gettextprop(c->win, netatom[NetWMName], ci->name, sizeof ci->name))
+		gettextprop(c->win, XA_WM_NAME, ci->name, sizeof ci->name);
+	if(ci->name[0] == '\0') /* hack to mark broken clients */
+		strcpy(ci->name, broken);
+	indexclient(c);
 }
 
 void
@@ -1775,23 +4996,60 @@ updatewmhints(Client *c) {
 void
 view(const Arg *arg) {
     unsigned int tmptag;
-	if(arg->i == mons->curtag || arg->i > (int) LENGTH(tags)) {
+	TagSet old;
+	Client *c;
+	int t;
+	if(arg->i < -1 || arg->i >= maxworkspaces
+	|| (arg->i == mons->curtag && onlytag(&mons->view, arg->i))) {
 		return;
     }
     if(arg->i == -1) { /* special case -- view previous tag */
         tmptag = mons->prevtag;
         mons->prevtag = mons->curtag;
         mons->curtag = tmptag;
+		old = mons->view;
+		mons->view = mons->prevview;
+		mons->prevview = old;
     }
     else {
+		getws(arg->i);
+		old = mons->prevview;
+		mons->prevview = mons->view;
+		memset(&mons->view, 0, sizeof mons->view);
+		settag(&mons->view, arg->i, True);
         mons->prevtag = mons->curtag;
 		mons->curtag = arg->i;
+		/* dropped out of the history */
+		for(t = nexttag(&old, 0); t != -1; t = nexttag(&old, t + 1))
+			releasews(t);
+		free(old.more);
     }
-
+	for(c = mons->clients; c; c = c->next)
+		if(ISVISIBLE(c))
+			refreshtitle(c);
+	notify("view", NULL);
 	focus(NULL);
 	arrange();
 }
 
+/* Returns the _NET_WM_PID of w, or 0. */
+long
+winpid(Window w) {
+	unsigned char *p = NULL;
+	unsigned long n, extra;
+	int format;
+	Atom type;
+	long pid = 0;
+
+	if(XGetWindowProperty(dpy, w, netatom[NetWMPid], 0L, 1L, False, XA_CARDINAL,
+	                      &type, &format, &n, &extra, &p) == Success && p) {
+		if(n == 1 && format == 32)
+			pid = *(long *)p;
+		XFree(p);
+	}
+	return pid;
+}
+
 Client *
 wintoclient(Window w) {
 	Client *c;
@@ -1815,7 +5073,13 @@ xerror(Display *dpy, XErrorEvent *ee) {
 	|| (ee->request_code == X_ConfigureWindow && ee->error_code == BadMatch)
 	|| (ee->request_code == X_GrabButton && ee->error_code == BadAccess)
 	|| (ee->request_code == X_GrabKey && ee->error_code == BadAccess)
-	|| (ee->request_code == X_CopyArea && ee->error_code == BadDrawable))
+	|| (ee->request_code == X_CopyArea && ee->error_code == BadDrawable)
+	|| (ee->request_code == X_OpenFont && ee->error_code == BadName)
+	|| (ee->request_code == X_QueryFont && ee->error_code == BadFont)
+#ifdef XSYNC
+	|| (synced && ee->error_code >= syncerror && ee->error_code < syncerror + XSyncNumberErrors)
+#endif /* XSYNC */
+	)
 		return 0;
 	fprintf(stderr, "ldwm: fatal error: request code=%d, error code=%d\n",
 			ee->request_code, ee->error_code);
@@ -1831,10 +5095,46 @@ xerrordummy(Display *dpy, XErrorEvent *ee) {
  * is already running. */
 int
 xerrorstart(Display *dpy, XErrorEvent *ee) {
+	if(restorefd >= 0) {
+		otherwm = True;
+		return -1;
+	}
 	die("ldwm: another window manager is already running\n");
 	return -1;
 }
 
+#ifdef SHM
+int
+xerrorshm(Display *dpy, XErrorEvent *ee) {
+	shmerror = True;
+	return 0;
+}
+#endif /* SHM */
+
+#ifdef XFT
+/* Xft composites with a render color, derive it from a pixel of the
+ * default visual without a round-trip where possible. */
+void
+xftcolor(unsigned long pixel, XftColor *c) {
+	Visual *v = DefaultVisual(dpy, screen);
+	XColor xc;
+
+	c->pixel = pixel;
+	c->color.alpha = 0xffff;
+	if(v->class == TrueColor) {
+		c->color.red = maskcomp(pixel, v->red_mask);
+		c->color.green = maskcomp(pixel, v->green_mask);
+		c->color.blue = maskcomp(pixel, v->blue_mask);
+		return;
+	}
+	xc.pixel = pixel;
+	XQueryColor(dpy, DefaultColormap(dpy, screen), &xc);
+	c->color.red = xc.red;
+	c->color.green = xc.green;
+	c->color.blue = xc.blue;
+}
+#endif /* XFT */
+
 void
 zoom(const Arg *arg) {
 	Client *c = mons->sel;
@@ -1849,19 +5149,49 @@ zoom(const Arg *arg) {
 
 int
 main(int argc, char *argv[]) {
+	char fdstr[16];
+	unsigned int i;
+	int fd = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &started);
 	if(argc == 2 && !strcmp("-v", argv[1]))
 		die("ldwm-"VERSION", © 2006-2013 (l)dwm engineers, see LICENSE for details\n");
+	else if(argc == 2 && !strcmp("-b", argv[1]))
+		benchmark = True;
+	else if(argc == 3 && !strcmp("-r", argv[1])) /* see restart() */
+		restorefd = atoi(argv[2]);
 	else if(argc != 1)
-		die("usage: ldwm [-v]\n");
+		die("usage: ldwm [-v] [-b]\n");
 	if(!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		fputs("warning: no locale support\n", stderr);
+	else
+		utf8locale = !strcmp(nl_langinfo(CODESET), "UTF-8");
 	if(!(dpy = XOpenDisplay(NULL)))
 		die("ldwm: cannot open display\n");
 	checkotherwm();
 	setup();
+	if(restorefd >= 0)
+		restorestate(restorefd);
+	restorefd = -1;
 	scan();
+	for(i = 0; i < LENGTH(pools) && !benchmark; i++)
+		fillpool(i);
 	run();
+	if(restarting && (fd = savestate()) == -1)
+		fputs("ldwm: restart: cannot save the state, starting afresh\n", stderr);
+	else if(restarting) {
+		/* leave the clients as they are for the next instance; the
+		 * connection is kept for cleanup() until the exec succeeded */
+		XSync(dpy, False);
+		fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+		snprintf(fdstr, sizeof fdstr, "%d", fd);
+		execlp(argv[0], argv[0], "-r", fdstr, (char *)NULL);
+		fprintf(stderr, "ldwm: restart: cannot exec %s\n", argv[0]);
+		close(fd);
+	}
 	cleanup();
 	XCloseDisplay(dpy);
-	return EXIT_SUCCESS;
+	if(restarting && fd == -1) /* the next instance adopts the windows with scan() */
+		execlp(argv[0], argv[0], (char *)NULL);
+	return restarting ? EXIT_FAILURE : EXIT_SUCCESS; /* the restart failed */
 }
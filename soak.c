@@ -0,0 +1,232 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Soaks ldwm to catch leaks: it starts an X server and the given ldwm on it,
+ * then for a number of rounds churns windows at random, opening, retitling,
+ * resizing, fullscreening and destroying them while tags, layouts and
+ * subscriptions change through the command socket. Every few rounds it
+ * samples ldwm's "resources" reply and the X resources XRes counts for
+ * ldwm's connection. It fails if either grew past its threshold since the
+ * first sample, taken once the first rounds have warmed ldwm's caches and
+ * pools up.
+ *
+ * usage: soak [-n rounds] [-s seed] [-r rss kB] [-x resources] ldwm xserver [args...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XRes.h>
+
+#include "driver.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define WINDOWS                 24
+#define SAMPLEEVERY             10      /* rounds */
+#define WARMUP                  5       /* rounds before the first sample */
+
+typedef struct {
+	long rss;             /* kB, as ldwm reports it */
+	long clients;
+	long xres;            /* X resources held by ldwm's connection */
+} Sample;
+
+static void churn(void);
+static long field(const char *reply, const char *name);
+static XID findwm(void);
+static void sample(Sample *s);
+static void sendmessage(Window w, Atom type, long l0, long l1);
+
+static XID wmbase;
+static Atom netstate, netfullscreen, netactive;
+static const char *classes[] = { "URxvt", "Firefox", "Gimp", "mpv", "Emacs" };
+static const char *cmds[] = {
+	"view %d", "toggleview %d", "tag %d", "toggletag %d", "setlayout %d",
+	"focusstack 1", "zoom", "togglefloating", "incnmaster 1", "incnmaster -1",
+};
+
+/* One round: a random batch of windows is mapped, then titles, sizes,
+ * fullscreen states, tags and layouts are changed in random order, and all
+ * windows go away again. */
+void
+churn(void) {
+	Window wins[WINDOWS];
+	XClassHint ch;
+	XSizeHints hints;
+	XEvent ev;
+	char title[300], line[64], reply[65536];
+	unsigned int i, j, n, mapped, len;
+	int sub = -1;
+
+	if(rand() % 2 && (sub = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) { /* a passing subscriber */
+		if(connect(sub, (struct sockaddr *)&addr, sizeof addr) < 0
+		|| write(sub, "subscribe\n", 10) != 10) {
+			close(sub);
+			sub = -1;
+		}
+	}
+	n = 1 + rand() % WINDOWS;
+	for(i = 0; i < n; i++) {
+		wins[i] = XCreateSimpleWindow(dpy, root, rand() % 400, rand() % 300,
+		                              50 + rand() % 600, 50 + rand() % 400, 0, 0, 0);
+		ch.res_name = ch.res_class = (char *)classes[rand() % LENGTH(classes)];
+		XSetClassHint(dpy, wins[i], &ch);
+		XStoreName(dpy, wins[i], ch.res_class);
+		if(!(rand() % 4)) { /* a fixed size one, which floats */
+			hints.flags = PMinSize | PMaxSize;
+			hints.min_width = hints.max_width = 200;
+			hints.min_height = hints.max_height = 100;
+			XSetWMNormalHints(dpy, wins[i], &hints);
+		}
+		XSelectInput(dpy, wins[i], StructureNotifyMask);
+		XMapWindow(dpy, wins[i]);
+	}
+	for(mapped = 0; mapped < n; ) {
+		XNextEvent(dpy, &ev);
+		mapped += ev.type == MapNotify;
+	}
+	for(j = 0; j < 4 * n; j++) {
+		i = rand() % n;
+		switch(rand() % 4) {
+		case 0:
+			len = rand() % (sizeof title - 1);
+			memset(title, 'a' + rand() % 26, len);
+			title[len] = '\0';
+			XStoreName(dpy, wins[i], title);
+			break;
+		case 1:
+			XMoveResizeWindow(dpy, wins[i], rand() % 800, rand() % 600,
+			                  1 + rand() % 800, 1 + rand() % 600);
+			break;
+		case 2:
+			snprintf(line, sizeof line, cmds[rand() % LENGTH(cmds)], rand() % 12);
+			XSync(dpy, False);
+			command(line, reply, sizeof reply);
+			break;
+		case 3: /* focused, so that ldwm holds work back while it is fullscreen */
+			sendmessage(wins[i], netstate, rand() % 2, netfullscreen);
+			sendmessage(wins[i], netactive, 1, 0);
+			break;
+		}
+	}
+	for(i = 0; i < n; i++)
+		XDestroyWindow(dpy, wins[i]);
+	XSync(dpy, False);
+	command("view 0", reply, sizeof reply);
+	while(XPending(dpy))
+		XNextEvent(dpy, &ev);
+	if(sub >= 0)
+		close(sub);
+}
+
+long
+field(const char *reply, const char *name) {
+	char key[32];
+	const char *p;
+
+	snprintf(key, sizeof key, "\"%s\":", name);
+	if(!(p = strstr(reply, key)))
+		die("%s: no %s in %s", argv0, name, reply);
+	return atol(p + strlen(key));
+}
+
+/* Returns the resource base of ldwm's connection: on a fresh server the
+ * only client besides the server itself and this one. */
+XID
+findwm(void) {
+	XResClient *clients;
+	Window us = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+	XID base = 0;
+	int i, n;
+
+	if(!XResQueryClients(dpy, &n, &clients))
+		die("%s: XResQueryClients failed\n", argv0);
+	for(i = 0; i < n && !base; i++)
+		if(clients[i].resource_base && (us & ~clients[i].resource_mask) != clients[i].resource_base)
+			base = clients[i].resource_base;
+	XFree(clients);
+	XDestroyWindow(dpy, us);
+	if(!base)
+		die("%s: cannot tell ldwm's connection\n", argv0);
+	return base;
+}
+
+void
+sample(Sample *s) {
+	XResType *types;
+	char reply[65536];
+	int i, n;
+
+	command("resources", reply, sizeof reply);
+	s->rss = field(reply, "rss");
+	s->clients = field(reply, "clients");
+	if(!XResQueryClientResources(dpy, wmbase, &n, &types))
+		die("%s: XResQueryClientResources failed\n", argv0);
+	for(s->xres = 0, i = 0; i < n; i++)
+		s->xres += types[i].count;
+	XFree(types);
+}
+
+void
+sendmessage(Window w, Atom type, long l0, long l1) {
+	XEvent ev = { .xclient = { .type = ClientMessage, .window = w,
+	                           .message_type = type, .format = 32 } };
+
+	ev.xclient.data.l[0] = l0;
+	ev.xclient.data.l[1] = l1;
+	XSendEvent(dpy, root, False, SubstructureNotifyMask | SubstructureRedirectMask, &ev);
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int rounds = 200, seed = 1, r;
+	long maxrss = 1024, maxxres = 16;
+	Sample first = { 0 }, last = { 0 };
+	int dummy;
+
+	argv0 = argv[0];
+	for(; argc > 2 && argv[1][0] == '-' && argv[1][1] && !argv[1][2]; argc -= 2, argv += 2)
+		switch(argv[1][1]) {
+		case 'n': rounds = atoi(argv[2]); break;
+		case 's': seed = atoi(argv[2]); break;
+		case 'r': maxrss = atol(argv[2]); break;
+		case 'x': maxxres = atol(argv[2]); break;
+		default: argc = 0; break;
+		}
+	if(argc < 3)
+		die("usage: soak [-n rounds] [-s seed] [-r rss kB] [-x resources] ldwm xserver [args...]\n");
+	srand(seed);
+
+	setup(argv[1], argv + 2);
+	netstate = XInternAtom(dpy, "_NET_WM_STATE", False);
+	netfullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+	netactive = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
+	if(!XResQueryExtension(dpy, &dummy, &dummy))
+		die("%s: the X server lacks the X-Resource extension\n", argv0);
+	wmbase = findwm();
+
+	for(r = 0; r < rounds; r++) {
+		churn();
+		if(r + 1 == WARMUP)
+			sample(&first);
+		else if(r + 1 > WARMUP && ((r + 1 - WARMUP) % SAMPLEEVERY == 0 || r + 1 == rounds)) {
+			sample(&last);
+			printf("round %u: rss %ld kB, %ld clients, %ld X resources\n",
+			       r + 1, last.rss, last.clients, last.xres);
+		}
+	}
+	if(rounds <= WARMUP)
+		die("%s: %u rounds are not past the warm-up of %d\n", argv0, rounds, WARMUP);
+	if(last.clients)
+		die("%s: ldwm still manages %ld clients of destroyed windows\n", argv0, last.clients);
+	if(last.rss - first.rss > maxrss)
+		die("%s: rss grew by %ld kB, more than %ld\n", argv0, last.rss - first.rss, maxrss);
+	if(last.xres - first.xres > maxxres)
+		die("%s: X resources grew by %ld, more than %ld\n", argv0, last.xres - first.xres, maxxres);
+	printf("soak: %u rounds, rss %+ld kB, X resources %+ld\n", rounds,
+	       last.rss - first.rss, last.xres - first.xres);
+	cleanup();
+	return EXIT_SUCCESS;
+}
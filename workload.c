@@ -0,0 +1,95 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Drives ldwm the way a desktop does, for training and comparing profile
+ * guided builds: it starts an X server and the given ldwm on it, then for a
+ * number of rounds maps a batch of windows, retitles and resizes them, sweeps
+ * the pointer across them, switches tags and layouts through the command
+ * socket and destroys them again. The time all rounds took is printed.
+ *
+ * usage: workload [-n rounds] ldwm xserver [args...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "driver.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define WINDOWS                 16
+
+static void maprounds(unsigned int rounds);
+
+static const char *cmds[] = {
+	"view 1", "view 0", "setlayout 2", "setlayout 0", "setmfact 0.6",
+	"incnmaster 1", "incnmaster -1", "focusstack 1", "focusstack 1", "zoom",
+	"toggleview 1", "toggleview 1", "state",
+};
+
+void
+maprounds(unsigned int rounds) {
+	Window wins[WINDOWS];
+	XClassHint ch = { "workload", "Workload" };
+	XEvent ev;
+	char title[32], reply[65536];
+	unsigned int r, i, j, mapped;
+
+	for(r = 0; r < rounds; r++) {
+		for(i = 0; i < WINDOWS; i++) {
+			wins[i] = XCreateSimpleWindow(dpy, root, 0, 0, 200 + i, 100 + i, 0, 0, 0);
+			XSetClassHint(dpy, wins[i], &ch);
+			XStoreName(dpy, wins[i], "workload");
+			XSelectInput(dpy, wins[i], StructureNotifyMask);
+			XMapWindow(dpy, wins[i]);
+		}
+		for(mapped = 0; mapped < WINDOWS; ) {
+			XNextEvent(dpy, &ev);
+			mapped += ev.type == MapNotify;
+		}
+		for(j = 0; j < 4; j++)
+			for(i = 0; i < WINDOWS; i++) {
+				snprintf(title, sizeof title, "workload %u.%u", i, j);
+				XStoreName(dpy, wins[i], title);
+				XMoveResizeWindow(dpy, wins[i], 10 * j, 10 * j, 300 + j, 200 + j);
+			}
+		for(i = 0; i < 64; i++) /* a sweep across the tiles */
+			XWarpPointer(dpy, None, root, 0, 0, 0, 0,
+			             i * DisplayWidth(dpy, DefaultScreen(dpy)) / 64,
+			             DisplayHeight(dpy, DefaultScreen(dpy)) / 2);
+		XSync(dpy, False);
+		for(i = 0; i < LENGTH(cmds); i++)
+			command(cmds[i], reply, sizeof reply);
+		for(i = 0; i < WINDOWS; i++)
+			XDestroyWindow(dpy, wins[i]);
+		XSync(dpy, False);
+		command("state", reply, sizeof reply);
+		while(XPending(dpy))
+			XNextEvent(dpy, &ev);
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int rounds = 20;
+	long t;
+
+	argv0 = argv[0];
+	if(argc > 2 && !strcmp(argv[1], "-n")) {
+		rounds = atoi(argv[2]);
+		argv += 2;
+		argc -= 2;
+	}
+	if(argc < 3)
+		die("usage: workload [-n rounds] ldwm xserver [args...]\n");
+	setup(argv[1], argv + 2);
+
+	t = now();
+	maprounds(rounds);
+	t = now() - t;
+	printf("%s: %u rounds in %ld ms, %ld us per round\n", argv[1], rounds, t,
+	       t * 1000 / (rounds ? rounds : 1));
+
+	cleanup(); /* a clean exit writes the profile */
+	return EXIT_SUCCESS;
+}